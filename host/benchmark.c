@@ -0,0 +1,186 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "compositor.h"
+#include "launchpad.h"
+#include "pad_layout.h"
+#include "usb_stub.h"
+
+// Paint a run of frames on each model in turn, driven by synthetic pad and
+// arrow presses, and report how much we send and how long it takes.
+//
+// Usage: launchpad-benchmark [frames]
+
+#define DEFAULT_FRAME_COUNT 1000
+
+// The host device the benchmark paints.
+#define BENCHMARK_DEVICE 0
+
+enum BenchmarkScenario {
+  // Move the cross about, so that only what has changed is painted.
+  SCENARIO_MOVE,
+  // Forget what's on the device before each frame, so that everything is painted.
+  SCENARIO_FULL_REPAINT,
+  // Move the cross up and back down again, so that the same two changes are
+  // painted over and over, and come from the frame cache.
+  SCENARIO_BACK_AND_FORTH,
+  // Paint everything, with a background in colours that aren't in the
+  // palette, so that devices that can show RGB colours have to.
+  SCENARIO_RGB_REPAINT,
+  SCENARIO_COUNT
+};
+
+static const char *scenario_names[SCENARIO_COUNT] = {
+  "move",
+  "full repaint",
+  "back and forth",
+  "rgb repaint"
+};
+
+struct benchmark_result {
+    uint32_t init_bytes;
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t cpu_ns;
+    int frame_count;
+};
+
+static uint64_t cpu_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+  return ((uint64_t) now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+// The controller for a control on this model, or zero if it doesn't have one.
+static uint8_t controller_for(const struct device_profile *profile, enum LaunchpadControl control) {
+  for (int controller = 0; controller < LAUNCHPAD_MAX_CONTROLS; controller++) {
+    if (profile->controls[controller] == control) {
+      return controller;
+    }
+  }
+  return 0;
+}
+
+// Alternate between pressing a pad and pressing an arrow.  The pads are
+// visited in a fixed order that jumps about the grid.
+static void make_input_packet(const struct device_profile *profile, enum BenchmarkScenario scenario, int frame, uint8_t *packet) {
+  const struct pad_layout *layout = get_pad_layout(profile->note_layout);
+  uint8_t cable_bits = profile->host_cable << 4;
+
+  if (scenario == SCENARIO_BACK_AND_FORTH) {
+    packet[0] = cable_bits | MIDI_CIN_CONTROL_CHANGE;
+    packet[1] = 0xB0;
+    packet[2] = controller_for(profile, frame % 2 == 0 ? LAUNCHPAD_CONTROL_UP : LAUNCHPAD_CONTROL_DOWN);
+    packet[3] = 127;
+    return;
+  }
+
+  if (frame % 2 == 0) {
+    for (int offset = 0; offset < LAUNCHPAD_GRID_CELLS; offset++) {
+      int cell = ((frame * 37) + offset) % LAUNCHPAD_GRID_CELLS;
+      const struct pad_address *pad = &layout->pad_for_cell[cell];
+      if (pad->status == 0x90) {
+        packet[0] = cable_bits | MIDI_CIN_NOTE_ON;
+        packet[1] = 0x90;
+        packet[2] = pad->number;
+        packet[3] = 127;
+        return;
+      }
+    }
+  }
+
+  enum LaunchpadControl control = (frame % 4 == 1) ? LAUNCHPAD_CONTROL_RIGHT : LAUNCHPAD_CONTROL_UP;
+  packet[0] = cable_bits | MIDI_CIN_CONTROL_CHANGE;
+  packet[1] = 0xB0;
+  packet[2] = controller_for(profile, control);
+  packet[3] = 127;
+}
+
+// A gradient that changes from frame to frame, so that every pad is painted.
+static void draw_rgb_background(int frame) {
+  for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+    int row = index / LAUNCHPAD_GRID_SIZE;
+    int column = index % LAUNCHPAD_GRID_SIZE;
+    struct led_colour colour = { (row * 13 + frame) % 128, (column * 11 + frame) % 128, ((row + column) * 5 + 1) % 128 };
+    compositor_set_cell(get_board_compositor(), COMPOSITOR_LAYER_BACKGROUND, index, colour, COMPOSITOR_OPAQUE);
+  }
+}
+
+static struct benchmark_result run_benchmark(enum LaunchpadModel model, enum BenchmarkScenario scenario, int frame_count) {
+  const struct device_profile *profile = get_device_profile(model);
+  struct benchmark_result result = { 0, 0, 0, 0, frame_count };
+
+  struct board_state board_state = { 4, 5, true, { { { false, LAUNCHPAD_MODEL_UNKNOWN } } }, false, 0 };
+  board_state.host.devices[BENCHMARK_DEVICE].is_mounted = true;
+  board_state.host.devices[BENCHMARK_DEVICE].model = model;
+
+  usb_stub_reset_counters();
+  initialise_host_launchpad(BENCHMARK_DEVICE, model);
+  service_host_launchpads();
+  result.init_bytes = usb_stub_get_host_counters(BENCHMARK_DEVICE).bytes;
+
+  static struct led_frame frame;
+  for (int frame_index = 0; frame_index < frame_count; frame_index++) {
+    uint8_t packet[USB_MIDI_PACKET_SIZE];
+    make_input_packet(profile, scenario, frame_index, packet);
+    usb_stub_push_host_input(BENCHMARK_DEVICE, packet);
+    while (tuh_midi_packet_read(BENCHMARK_DEVICE, packet)) {
+      process_incoming_host_packet(BENCHMARK_DEVICE, packet, &board_state);
+    }
+
+    if (scenario == SCENARIO_FULL_REPAINT || scenario == SCENARIO_RGB_REPAINT) {
+      invalidate_host_shadow(BENCHMARK_DEVICE);
+    }
+
+    if (scenario == SCENARIO_RGB_REPAINT) {
+      draw_rgb_background(frame_index);
+    }
+
+    usb_stub_reset_counters();
+
+    uint64_t start_ns = cpu_time_ns();
+    render_board_frame(&board_state, &frame);
+    paint_host_launchpads(&frame);
+    service_host_launchpads();
+    result.cpu_ns += cpu_time_ns() - start_ns;
+
+    struct usb_stub_counters counters = usb_stub_get_host_counters(BENCHMARK_DEVICE);
+    result.bytes += counters.bytes;
+    result.packets += counters.packets;
+  }
+
+  release_host_launchpad(BENCHMARK_DEVICE);
+  compositor_clear_layer(get_board_compositor(), COMPOSITOR_LAYER_BACKGROUND);
+
+  return result;
+}
+
+int main(int argc, char **argv) {
+  int frame_count = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAME_COUNT;
+  if (frame_count <= 0) {
+    fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-20s %-15s %10s %12s %14s %14s\n", "model", "scenario", "init bytes", "bytes/frame", "packets/frame", "cpu us/frame");
+
+  for (int model = LAUNCHPAD_MODEL_UNKNOWN + 1; model < LAUNCHPAD_MODEL_COUNT; model++) {
+    for (int scenario = 0; scenario < SCENARIO_COUNT; scenario++) {
+      struct benchmark_result result = run_benchmark(model, scenario, frame_count);
+
+      printf("%-20s %-15s %10u %12.1f %14.1f %14.2f\n",
+        get_device_profile(model)->name,
+        scenario_names[scenario],
+        result.init_bytes,
+        (double) result.bytes / result.frame_count,
+        (double) result.packets / result.frame_count,
+        (double) result.cpu_ns / result.frame_count / 1000.0
+      );
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "flash_stub.h"
+
+static uint8_t flash[FLASH_REGION_SIZE];
+static bool is_initialised = false;
+
+static struct flash_stub_counters counters;
+
+void flash_stub_reset(void) {
+  memset(flash, 0xFF, sizeof(flash));
+  memset(&counters, 0, sizeof(counters));
+  is_initialised = true;
+}
+
+static void initialise(void) {
+  if (!is_initialised) {
+    flash_stub_reset();
+  }
+}
+
+struct flash_stub_counters flash_stub_get_counters(void) {
+  return counters;
+}
+
+const uint8_t *flash_region_contents(void) {
+  initialise();
+  return flash;
+}
+
+bool flash_region_erase_sector(uint32_t sector) {
+  initialise();
+  if (sector >= FLASH_REGION_SECTORS) {
+    return false;
+  }
+
+  memset(flash + (sector * FLASH_REGION_SECTOR_SIZE), 0xFF, FLASH_REGION_SECTOR_SIZE);
+  counters.sector_erases[sector]++;
+  return true;
+}
+
+// Programming can only clear bits, like the real thing.
+bool flash_region_program_page(uint32_t offset, const uint8_t *page) {
+  initialise();
+  if (offset % FLASH_REGION_PAGE_SIZE != 0 || offset >= FLASH_REGION_SIZE) {
+    return false;
+  }
+
+  for (uint32_t index = 0; index < FLASH_REGION_PAGE_SIZE; index++) {
+    flash[offset + index] &= page[index];
+  }
+  counters.page_programs++;
+  return true;
+}
@@ -0,0 +1,29 @@
+#ifndef _FLASH_STUB_H_
+#define _FLASH_STUB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "flash_region.h"
+
+// A stand-in for the flash region, kept in RAM, that counts how often each
+// sector is erased so that we can check the wear levelling.
+
+struct flash_stub_counters {
+    uint32_t sector_erases[FLASH_REGION_SECTORS];
+    uint32_t page_programs;
+};
+
+// Start again with erased flash.
+void flash_stub_reset(void);
+
+struct flash_stub_counters flash_stub_get_counters(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FLASH_STUB_H_ */
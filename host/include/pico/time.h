@@ -0,0 +1,17 @@
+#ifndef _PICO_TIME_H_
+#define _PICO_TIME_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Microseconds since the stub started, like the Pico's timer.
+uint32_t time_us_32(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PICO_TIME_H_ */
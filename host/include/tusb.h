@@ -0,0 +1,62 @@
+#ifndef _TUSB_H_
+#define _TUSB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Just enough of TinyUSB's interface to build the Launchpad engine on the
+// machine running the build.  The functions are implemented by usb_stub.c,
+// which records everything written instead of sending it anywhere.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define OPT_MCU_NONE 0
+#define OPT_OS_NONE 1
+#define OPT_MODE_DEVICE 0x0001
+#define OPT_MODE_HIGH_SPEED 0x0400
+#define OPT_MODE_DEFAULT_SPEED 0x0000
+
+#define CFG_TUSB_MCU OPT_MCU_NONE
+#define TUD_OPT_HIGH_SPEED 0
+
+#include "tusb_config.h"
+
+enum {
+  MIDI_CIN_MISC = 0,
+  MIDI_CIN_CABLE_EVENT = 1,
+  MIDI_CIN_SYSCOM_2BYTE = 2,
+  MIDI_CIN_SYSCOM_3BYTE = 3,
+  MIDI_CIN_SYSEX_START = 4,
+  MIDI_CIN_SYSEX_END_1BYTE = 5,
+  MIDI_CIN_SYSEX_END_2BYTE = 6,
+  MIDI_CIN_SYSEX_END_3BYTE = 7,
+  MIDI_CIN_NOTE_OFF = 8,
+  MIDI_CIN_NOTE_ON = 9,
+  MIDI_CIN_POLY_KEYPRESS = 10,
+  MIDI_CIN_CONTROL_CHANGE = 11,
+  MIDI_CIN_PROGRAM_CHANGE = 12,
+  MIDI_CIN_CHANNEL_PRESSURE = 13,
+  MIDI_CIN_PITCH_BEND_CHANGE = 14,
+  MIDI_CIN_1BYTE_DATA = 15
+};
+
+// Device (client) side.
+bool tud_midi_mounted(void);
+uint32_t tud_midi_available(void);
+bool tud_midi_packet_read(uint8_t packet[4]);
+bool tud_midi_packet_write(const uint8_t packet[4]);
+
+// Host side.
+bool tuh_midi_mounted(uint8_t idx);
+bool tuh_midi_packet_read(uint8_t idx, uint8_t packet[4]);
+uint32_t tuh_midi_write_available(uint8_t idx);
+uint32_t tuh_midi_packet_write_n(uint8_t idx, const uint8_t *buffer, uint32_t bufsize);
+uint32_t tuh_midi_write_flush(uint8_t idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TUSB_H_ */
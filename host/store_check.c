@@ -0,0 +1,169 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "flash_stub.h"
+#include "persistent_store.h"
+
+// Checks the persistent store against the RAM flash stub: that saves go all
+// the way round the ring and come back after a restart, that a save cut off
+// part way through is ignored, and how often each sector is erased.
+//
+// Usage: launchpad-store-check
+//   Exits with an error if any check fails.
+
+// Enough for a few trips round the ring.
+#define SAVE_COUNT (FLASH_REGION_SIZE / PERSISTENT_STORE_SLOT_SIZE * 3)
+
+// More than any save takes: one erase and every page of a slot.
+#define MAX_TASK_CALLS 16
+
+static int failures = 0;
+
+#define CHECK(condition, ...) do { \
+    if (!(condition)) { \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      failures++; \
+    } \
+  } while (0)
+
+static uint32_t now = 0;
+
+static void make_state(struct persistent_state *state, uint8_t value) {
+  memset(state, 0, sizeof(*state));
+  state->active_row = value % 10;
+  state->active_column = value / 10;
+  state->route_count = value;
+}
+
+static bool state_matches(uint8_t value) {
+  struct persistent_state expected;
+  struct persistent_state loaded;
+  make_state(&expected, value);
+  return persistent_store_load(&loaded) && memcmp(&expected, &loaded, sizeof(loaded)) == 0;
+}
+
+// Ask for a save, and give the store `task_calls` chances to write it, as the
+// main loop would once the save is due.
+static void save(uint8_t value, bool can_erase, int task_calls) {
+  struct persistent_state state;
+  make_state(&state, value);
+  persistent_store_request_save(&state, now);
+
+  now += PERSISTENT_STORE_SAVE_DELAY_US;
+  for (int call = 0; call < task_calls; call++) {
+    persistent_store_task(now, can_erase);
+  }
+}
+
+// Every save comes back after a restart, however many times the ring wraps.
+static void check_wrap(void) {
+  flash_stub_reset();
+  persistent_store_init();
+  CHECK(!persistent_store_load(&(struct persistent_state) { 0 }), "blank flash should have nothing to load");
+
+  for (int value = 0; value < SAVE_COUNT; value++) {
+    save(value, true, MAX_TASK_CALLS);
+    CHECK(!persistent_store_is_saving(), "save %d didn't finish", value);
+
+    persistent_store_init();
+    CHECK(state_matches(value), "save %d didn't load after a restart", value);
+  }
+
+  // Each trip round the ring erases each sector once, apart from the first,
+  // which starts out blank.
+  struct flash_stub_counters counters = flash_stub_get_counters();
+  for (int sector = 0; sector < FLASH_REGION_SECTORS; sector++) {
+    CHECK(counters.sector_erases[sector] <= 3, "sector %d erased %u times", sector, counters.sector_erases[sector]);
+  }
+}
+
+// Without a restart, or anywhere for the pause not to matter, a save that
+// needs an erase only waits until the deadline.
+static void check_erase_deadline(void) {
+  flash_stub_reset();
+  persistent_store_init();
+
+  for (int value = 0; value < SAVE_COUNT; value++) {
+    save(value, false, MAX_TASK_CALLS);
+    if (persistent_store_is_saving()) {
+      now += PERSISTENT_STORE_ERASE_DEADLINE_US;
+      for (int call = 0; call < MAX_TASK_CALLS; call++) {
+        persistent_store_task(now, false);
+      }
+    }
+
+    CHECK(!persistent_store_is_saving(), "save %d is still waiting after the deadline", value);
+    CHECK(state_matches(value), "save %d didn't load", value);
+  }
+}
+
+// A save that loses power before its header is written, or whose contents
+// don't match the CRC, is ignored in favour of the one before, and the next
+// save still works.
+static void check_torn_slots(void) {
+  flash_stub_reset();
+  persistent_store_init();
+  save(1, true, MAX_TASK_CALLS);
+
+  // The header goes in last, so one page in, the slot is still headerless.
+  save(2, true, 2);
+  CHECK(persistent_store_is_saving(), "save should still be in progress");
+  persistent_store_init();
+  CHECK(state_matches(1), "a slot without a header should be ignored");
+
+  save(3, true, MAX_TASK_CALLS);
+  persistent_store_init();
+  CHECK(state_matches(3), "the save after a torn one didn't load");
+
+  // Clear the first byte of the newest slot's state, just after the 16 byte
+  // header, which breaks its CRC.
+  save(4, true, MAX_TASK_CALLS);
+  const uint8_t *contents = flash_region_contents();
+  int newest = -1;
+  for (int offset = 0; offset < FLASH_REGION_SIZE; offset += PERSISTENT_STORE_SLOT_SIZE) {
+    if (contents[offset] != 0xFF) {
+      newest = offset;
+    }
+  }
+
+  uint8_t page[FLASH_REGION_PAGE_SIZE];
+  memset(page, 0xFF, sizeof(page));
+  page[16] = 0x00;
+  flash_region_program_page(newest, page);
+
+  persistent_store_init();
+  CHECK(state_matches(3), "a slot with a bad CRC should be ignored");
+}
+
+// The newest save is the one with the highest sequence number, not the one
+// furthest into the region, once the ring has wrapped.
+static void check_latest_sequence(void) {
+  flash_stub_reset();
+  persistent_store_init();
+
+  int slots = FLASH_REGION_SIZE / PERSISTENT_STORE_SLOT_SIZE;
+  for (int value = 0; value < slots + 2; value++) {
+    save(value, true, MAX_TASK_CALLS);
+  }
+
+  persistent_store_init();
+  CHECK(state_matches(slots + 1), "init should pick the save with the highest sequence number");
+}
+
+int main(void) {
+  check_wrap();
+  check_erase_deadline();
+  check_torn_slots();
+  check_latest_sequence();
+
+  if (failures > 0) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+
+  printf("all checks passed\n");
+  return 0;
+}
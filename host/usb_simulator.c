@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "launchpad.h"
+#include "usb_stub.h"
+
+// Simulate a full speed USB bus, to predict how long it takes each Launchpad
+// to receive a whole frame.  The real engine paints into the stub's FIFOs,
+// and every 1 ms USB frame we move as many 64 byte bulk packets out of them as
+// the bus allows, letting the engine refill the FIFOs as they drain.
+//
+// The client side (our virtual cables) and the host side (the devices on the
+// host port) are separate buses.  All of the client cables share one FIFO and
+// endpoint, each host device has its own FIFO, and the host devices share the
+// host bus.
+//
+// Usage: launchpad-usb-sim [options]
+//   --host-devices <0-4>       how many devices to attach to the host port
+//   --client-fifo <bytes>      size of the client transmit FIFO
+//   --host-fifo <bytes>        size of each host transmit FIFO
+//   --bulk-packets <n>         bulk packets each bus can carry per USB frame
+//   --max-latency-us <us>      exit with an error if any device takes longer
+
+#define USB_FRAME_US 1000
+#define USB_BULK_PACKET_SIZE 64
+#define MIDI_PACKETS_PER_BULK_PACKET (USB_BULK_PACKET_SIZE / USB_MIDI_PACKET_SIZE)
+
+// The most 64 byte bulk transactions that fit in a full speed frame, from
+// table 5-10 of the USB 2.0 spec.
+#define USB_FS_MAX_BULK_PACKETS_PER_FRAME 19
+
+// Give up on a frame that hasn't arrived after this long.
+#define SIMULATION_TIMEOUT_US 1000000
+
+#define MAX_DESTINATIONS (CFG_TUD_MIDI_NUMCABLES_OUT + MAX_HOST_LAUNCHPADS)
+
+struct simulator_config {
+    int host_device_count;
+    uint32_t client_fifo_bytes;
+    uint32_t host_fifo_bytes;
+    uint16_t bulk_packets_per_frame;
+    uint32_t max_latency_us;
+};
+
+// A client cable or a host device, and how much of the current frame it has.
+struct destination {
+    bool is_host;
+    uint8_t index;
+    uint32_t packets_delivered;
+    uint32_t bulk_packets;
+    bool is_complete;
+    uint32_t complete_time;
+};
+
+// The models we attach to the host port, in order.
+static const enum LaunchpadModel host_models[MAX_HOST_LAUNCHPADS] = {
+  LAUNCHPAD_MODEL_S,
+  LAUNCHPAD_MODEL_PRO_MK2,
+  LAUNCHPAD_MODEL_PRO_MK3,
+  LAUNCHPAD_MODEL_X
+};
+
+static struct destination destinations[MAX_DESTINATIONS];
+static int destination_count = 0;
+
+static uint32_t now_us = 0;
+
+static struct destination *find_destination(bool is_host, uint8_t index) {
+  for (int destination_index = 0; destination_index < destination_count; destination_index++) {
+    if (destinations[destination_index].is_host == is_host && destinations[destination_index].index == index) {
+      return &destinations[destination_index];
+    }
+  }
+  return NULL;
+}
+
+static uint32_t packets_written(const struct destination *destination) {
+  struct usb_stub_counters counters = destination->is_host ? usb_stub_get_host_counters(destination->index) : usb_stub_get_client_counters(destination->index);
+  return counters.packets;
+}
+
+static uint16_t packets_queued(const struct destination *destination) {
+  struct packet_queue_stats stats = destination->is_host ? get_host_queue_stats(destination->index) : get_client_queue_stats(destination->index);
+  return stats.queued_packets;
+}
+
+// A destination has its frame once the engine has nothing left to send it,
+// and everything it did send has crossed the bus.
+static void update_completion(struct destination *destination, uint32_t time) {
+  if (!destination->is_complete && packets_queued(destination) == 0 && destination->packets_delivered == packets_written(destination)) {
+    destination->is_complete = true;
+    destination->complete_time = time;
+  }
+}
+
+// The firmware's main loops run far more often than the bus moves data, so we
+// let them top up the FIFOs after every bulk packet.
+static void run_firmware(void) {
+  usb_stub_set_simulated_time(now_us);
+  service_client_launchpads();
+  service_host_launchpads();
+}
+
+static void send_client_bulk_packet(uint32_t time) {
+  uint8_t cables[MIDI_PACKETS_PER_BULK_PACKET];
+  uint16_t packet_count = usb_stub_take_client_packets(MIDI_PACKETS_PER_BULK_PACKET, cables);
+
+  for (uint16_t packet_index = 0; packet_index < packet_count; packet_index++) {
+    struct destination *destination = find_destination(false, cables[packet_index]);
+    if (destination) {
+      destination->packets_delivered++;
+    }
+  }
+
+  for (uint8_t cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    struct destination *destination = find_destination(false, cable);
+    bool is_in_packet = false;
+    for (uint16_t packet_index = 0; packet_index < packet_count; packet_index++) {
+      is_in_packet = is_in_packet || cables[packet_index] == cable;
+    }
+
+    if (destination && is_in_packet) {
+      destination->bulk_packets++;
+      update_completion(destination, time);
+    }
+  }
+}
+
+static bool send_host_bulk_packet(uint8_t idx, uint32_t time) {
+  uint16_t packet_count = usb_stub_take_host_packets(idx, MIDI_PACKETS_PER_BULK_PACKET);
+  if (packet_count == 0) {
+    return false;
+  }
+
+  struct destination *destination = find_destination(true, idx);
+  destination->packets_delivered += packet_count;
+  destination->bulk_packets++;
+  update_completion(destination, time);
+  return true;
+}
+
+static bool is_everything_complete(void) {
+  for (int destination_index = 0; destination_index < destination_count; destination_index++) {
+    if (!destinations[destination_index].is_complete) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Paint a frame, then run the buses until every destination has all of it.
+// Returns false if that doesn't happen before the timeout.
+static bool simulate_frame(const struct simulator_config *config, const struct led_frame *frame) {
+  uint32_t start_us = now_us;
+
+  usb_stub_reset_counters();
+  for (int destination_index = 0; destination_index < destination_count; destination_index++) {
+    destinations[destination_index].packets_delivered = 0;
+    destinations[destination_index].bulk_packets = 0;
+    destinations[destination_index].is_complete = false;
+  }
+
+  usb_stub_set_simulated_time(now_us);
+  paint_client_launchpads(frame);
+  paint_host_launchpads(frame);
+  service_host_launchpads();
+
+  for (int destination_index = 0; destination_index < destination_count; destination_index++) {
+    update_completion(&destinations[destination_index], start_us);
+  }
+
+  uint8_t next_host_idx = 0;
+  while (!is_everything_complete() && now_us - start_us < SIMULATION_TIMEOUT_US) {
+    // Each bulk packet finishes a fixed share of the way through the frame.
+    for (uint16_t slot = 0; slot < config->bulk_packets_per_frame; slot++) {
+      uint32_t slot_end = now_us + ((slot + 1) * USB_FRAME_US / config->bulk_packets_per_frame);
+
+      send_client_bulk_packet(slot_end);
+
+      // The host devices take turns on the host bus.
+      for (int attempt = 0; attempt < config->host_device_count; attempt++) {
+        uint8_t idx = next_host_idx;
+        next_host_idx = (next_host_idx + 1) % config->host_device_count;
+        if (send_host_bulk_packet(idx, slot_end)) {
+          break;
+        }
+      }
+
+      run_firmware();
+    }
+
+    now_us += USB_FRAME_US;
+    run_firmware();
+  }
+
+  return is_everything_complete();
+}
+
+static void print_results(const char *scenario, const struct simulator_config *config, bool *is_within_limit) {
+  printf("\n%s\n", scenario);
+  printf("%-28s %10s %14s %12s %12s\n", "destination", "bytes", "midi packets", "bulk packets", "latency us");
+
+  for (int destination_index = 0; destination_index < destination_count; destination_index++) {
+    const struct destination *destination = &destinations[destination_index];
+
+    char label[40];
+    if (destination->is_host) {
+      snprintf(label, sizeof(label), "host %u (%s)", destination->index, get_device_profile(host_models[destination->index])->name);
+    }
+    else {
+      snprintf(label, sizeof(label), "client cable %u", destination->index);
+    }
+
+    uint32_t written = packets_written(destination);
+    if (destination->is_complete) {
+      printf("%-28s %10u %14u %12u %12u\n", label, written * USB_MIDI_PACKET_SIZE, written, destination->bulk_packets, destination->complete_time);
+    }
+    else {
+      printf("%-28s %10u %14u %12u %12s\n", label, written * USB_MIDI_PACKET_SIZE, written, destination->bulk_packets, "timeout");
+    }
+
+    if (!destination->is_complete || (config->max_latency_us > 0 && destination->complete_time > config->max_latency_us)) {
+      *is_within_limit = false;
+    }
+  }
+}
+
+// Make latencies relative to when the frame was painted.
+static void rebase_completion_times(uint32_t start_us) {
+  for (int destination_index = 0; destination_index < destination_count; destination_index++) {
+    destinations[destination_index].complete_time -= start_us;
+  }
+}
+
+static bool parse_args(int argc, char **argv, struct simulator_config *config) {
+  for (int arg_index = 1; arg_index < argc; arg_index++) {
+    if (arg_index + 1 >= argc) {
+      return false;
+    }
+
+    const char *option = argv[arg_index];
+    long value = atol(argv[++arg_index]);
+
+    if (strcmp(option, "--host-devices") == 0 && value >= 0 && value <= MAX_HOST_LAUNCHPADS) {
+      config->host_device_count = value;
+    }
+    else if (strcmp(option, "--client-fifo") == 0 && value >= USB_MIDI_PACKET_SIZE) {
+      config->client_fifo_bytes = value;
+    }
+    else if (strcmp(option, "--host-fifo") == 0 && value >= USB_MIDI_PACKET_SIZE) {
+      config->host_fifo_bytes = value;
+    }
+    else if (strcmp(option, "--bulk-packets") == 0 && value > 0 && value <= USB_FS_MAX_BULK_PACKETS_PER_FRAME) {
+      config->bulk_packets_per_frame = value;
+    }
+    else if (strcmp(option, "--max-latency-us") == 0 && value > 0) {
+      config->max_latency_us = value;
+    }
+    else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  struct simulator_config config = {
+    MAX_HOST_LAUNCHPADS,
+    CFG_TUD_MIDI_TX_BUFSIZE,
+    CFG_TUH_MIDI_TX_BUFSIZE,
+    USB_FS_MAX_BULK_PACKETS_PER_FRAME,
+    0
+  };
+
+  if (!parse_args(argc, argv, &config)) {
+    fprintf(stderr, "usage: %s [--host-devices n] [--client-fifo bytes] [--host-fifo bytes] [--bulk-packets n] [--max-latency-us us]\n", argv[0]);
+    return 2;
+  }
+
+  printf("client FIFO %u bytes, host FIFO %u bytes, %u bulk packets per frame, %d host devices\n",
+    config.client_fifo_bytes, config.host_fifo_bytes, config.bulk_packets_per_frame, config.host_device_count);
+
+  usb_stub_set_fifo_sizes(config.client_fifo_bytes, config.host_fifo_bytes);
+  usb_stub_set_simulated_time(now_us);
+
+  for (uint8_t cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    destinations[destination_count++] = (struct destination) { false, cable, 0, 0, false, 0 };
+  }
+
+  for (uint8_t idx = 0; idx < config.host_device_count; idx++) {
+    destinations[destination_count++] = (struct destination) { true, idx, 0, 0, false, 0 };
+  }
+
+  // The first frame includes setting each device up and painting all of it.
+  initialise_client_launchpads();
+  for (uint8_t idx = 0; idx < config.host_device_count; idx++) {
+    initialise_host_launchpad(idx, host_models[idx]);
+  }
+
+  struct board_state board_state = { 4, 5, true, { { { false, LAUNCHPAD_MODEL_UNKNOWN } } }, false, 0 };
+  struct led_frame frame;
+  bool is_within_limit = true;
+
+  uint32_t start_us = now_us;
+  render_board_frame(&board_state, &frame);
+  simulate_frame(&config, &frame);
+  rebase_completion_times(start_us);
+  print_results("first frame (initialise and paint everything)", &config, &is_within_limit);
+
+  // Then a typical update, moving the cross one column over.
+  board_state.active_column = (board_state.active_column + 1) % LAUNCHPAD_GRID_SIZE;
+  start_us = now_us;
+  render_board_frame(&board_state, &frame);
+  simulate_frame(&config, &frame);
+  rebase_completion_times(start_us);
+  print_results("move (cross moves one column)", &config, &is_within_limit);
+
+  if (!is_within_limit) {
+    printf("\nFAIL: at least one device took longer than allowed\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,239 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <string.h>
+#include <time.h>
+
+#include "pico/time.h"
+#include "usb_stub.h"
+
+#define USB_STUB_INPUT_LENGTH 64
+
+// Packets waiting to be read, one queue for the client side and one for each
+// host device.
+struct usb_stub_input {
+    uint8_t packets[USB_STUB_INPUT_LENGTH][USB_MIDI_PACKET_SIZE];
+    uint16_t head;
+    uint16_t count;
+};
+
+static struct usb_stub_counters client_counters[CFG_TUD_MIDI_NUMCABLES_OUT];
+static struct usb_stub_counters host_counters[MAX_HOST_LAUNCHPADS];
+
+static struct usb_stub_input client_input;
+static struct usb_stub_input host_inputs[MAX_HOST_LAUNCHPADS];
+
+static usb_stub_recorder recorder = NULL;
+static void *recorder_context = NULL;
+
+// The simulated transmit FIFOs, in packets, where zero means "never full".
+// The client FIFO is shared by every cable, so we keep track of which cable
+// each packet belongs to.
+static uint16_t client_fifo_size = 0;
+static uint16_t host_fifo_size = 0;
+
+static uint8_t client_fifo_cables[USB_STUB_MAX_FIFO_PACKETS];
+static uint16_t client_fifo_head = 0;
+static uint16_t client_fifo_count = 0;
+
+static uint16_t host_fifo_counts[MAX_HOST_LAUNCHPADS];
+
+static bool is_time_simulated = false;
+static uint32_t simulated_time_us = 0;
+
+void usb_stub_reset_counters(void) {
+  memset(client_counters, 0, sizeof(client_counters));
+  memset(host_counters, 0, sizeof(host_counters));
+}
+
+struct usb_stub_counters usb_stub_get_client_counters(uint8_t cable) {
+  struct usb_stub_counters counters = { 0, 0 };
+  if (cable < CFG_TUD_MIDI_NUMCABLES_OUT) {
+    counters = client_counters[cable];
+  }
+  return counters;
+}
+
+struct usb_stub_counters usb_stub_get_host_counters(uint8_t idx) {
+  struct usb_stub_counters counters = { 0, 0 };
+  if (idx < MAX_HOST_LAUNCHPADS) {
+    counters = host_counters[idx];
+  }
+  return counters;
+}
+
+void usb_stub_set_recorder(usb_stub_recorder new_recorder, void *context) {
+  recorder = new_recorder;
+  recorder_context = context;
+}
+
+static bool push_input(struct usb_stub_input *input, const uint8_t *packet) {
+  if (input->count == USB_STUB_INPUT_LENGTH) {
+    return false;
+  }
+
+  uint16_t tail = (input->head + input->count) % USB_STUB_INPUT_LENGTH;
+  memcpy(input->packets[tail], packet, USB_MIDI_PACKET_SIZE);
+  input->count++;
+  return true;
+}
+
+static bool pop_input(struct usb_stub_input *input, uint8_t *packet) {
+  if (input->count == 0) {
+    return false;
+  }
+
+  memcpy(packet, input->packets[input->head], USB_MIDI_PACKET_SIZE);
+  input->head = (input->head + 1) % USB_STUB_INPUT_LENGTH;
+  input->count--;
+  return true;
+}
+
+bool usb_stub_push_client_input(const uint8_t *packet) {
+  return push_input(&client_input, packet);
+}
+
+bool usb_stub_push_host_input(uint8_t idx, const uint8_t *packet) {
+  return idx < MAX_HOST_LAUNCHPADS && push_input(&host_inputs[idx], packet);
+}
+
+static uint16_t fifo_packets_for(uint32_t size_bytes) {
+  uint32_t packets = size_bytes / USB_MIDI_PACKET_SIZE;
+  return packets > USB_STUB_MAX_FIFO_PACKETS ? USB_STUB_MAX_FIFO_PACKETS : packets;
+}
+
+void usb_stub_set_fifo_sizes(uint32_t client_bytes, uint32_t host_bytes) {
+  client_fifo_size = fifo_packets_for(client_bytes);
+  host_fifo_size = fifo_packets_for(host_bytes);
+
+  client_fifo_head = 0;
+  client_fifo_count = 0;
+  memset(host_fifo_counts, 0, sizeof(host_fifo_counts));
+}
+
+// Take up to `max_packets` packets from the front of the client FIFO, noting
+// the cable each one belongs to.
+uint16_t usb_stub_take_client_packets(uint16_t max_packets, uint8_t *cables) {
+  uint16_t packet_count = client_fifo_count < max_packets ? client_fifo_count : max_packets;
+
+  for (uint16_t packet_index = 0; packet_index < packet_count; packet_index++) {
+    cables[packet_index] = client_fifo_cables[client_fifo_head];
+    client_fifo_head = (client_fifo_head + 1) % USB_STUB_MAX_FIFO_PACKETS;
+  }
+
+  client_fifo_count -= packet_count;
+  return packet_count;
+}
+
+uint16_t usb_stub_take_host_packets(uint8_t idx, uint16_t max_packets) {
+  if (idx >= MAX_HOST_LAUNCHPADS) {
+    return 0;
+  }
+
+  uint16_t packet_count = host_fifo_counts[idx] < max_packets ? host_fifo_counts[idx] : max_packets;
+  host_fifo_counts[idx] -= packet_count;
+  return packet_count;
+}
+
+uint16_t usb_stub_get_host_fifo_packets(uint8_t idx) {
+  return idx < MAX_HOST_LAUNCHPADS ? host_fifo_counts[idx] : 0;
+}
+
+void usb_stub_set_simulated_time(uint32_t now) {
+  is_time_simulated = true;
+  simulated_time_us = now;
+}
+
+static void record_packet(bool is_host, uint8_t index, const uint8_t *packet) {
+  struct usb_stub_counters *counters = is_host ? &host_counters[index] : &client_counters[index];
+  counters->bytes += USB_MIDI_PACKET_SIZE;
+  counters->packets++;
+
+  if (recorder) {
+    recorder(recorder_context, is_host, index, packet);
+  }
+}
+
+uint32_t time_us_32(void) {
+  if (is_time_simulated) {
+    return simulated_time_us;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t) ((now.tv_sec * 1000000ULL) + (now.tv_nsec / 1000));
+}
+
+bool tud_midi_mounted(void) {
+  return true;
+}
+
+uint32_t tud_midi_available(void) {
+  return client_input.count * USB_MIDI_PACKET_SIZE;
+}
+
+bool tud_midi_packet_read(uint8_t packet[4]) {
+  return pop_input(&client_input, packet);
+}
+
+bool tud_midi_packet_write(const uint8_t packet[4]) {
+  uint8_t cable = packet[0] >> 4;
+  if (cable >= CFG_TUD_MIDI_NUMCABLES_OUT) {
+    return true;
+  }
+
+  if (client_fifo_size > 0) {
+    if (client_fifo_count >= client_fifo_size) {
+      return false;
+    }
+
+    client_fifo_cables[(client_fifo_head + client_fifo_count) % USB_STUB_MAX_FIFO_PACKETS] = cable;
+    client_fifo_count++;
+  }
+
+  record_packet(false, cable, packet);
+  return true;
+}
+
+bool tuh_midi_mounted(uint8_t idx) {
+  return idx < MAX_HOST_LAUNCHPADS;
+}
+
+bool tuh_midi_packet_read(uint8_t idx, uint8_t packet[4]) {
+  return idx < MAX_HOST_LAUNCHPADS && pop_input(&host_inputs[idx], packet);
+}
+
+uint32_t tuh_midi_write_available(uint8_t idx) {
+  if (idx >= MAX_HOST_LAUNCHPADS) {
+    return 0;
+  }
+
+  if (host_fifo_size > 0) {
+    return (host_fifo_size - host_fifo_counts[idx]) * USB_MIDI_PACKET_SIZE;
+  }
+
+  return CFG_TUH_MIDI_TX_BUFSIZE;
+}
+
+uint32_t tuh_midi_packet_write_n(uint8_t idx, const uint8_t *buffer, uint32_t bufsize) {
+  if (idx >= MAX_HOST_LAUNCHPADS) {
+    return 0;
+  }
+
+  uint32_t packet_count = bufsize / USB_MIDI_PACKET_SIZE;
+  if (host_fifo_size > 0) {
+    uint32_t free_packets = host_fifo_size - host_fifo_counts[idx];
+    packet_count = packet_count < free_packets ? packet_count : free_packets;
+    host_fifo_counts[idx] += packet_count;
+  }
+
+  for (uint32_t packet_index = 0; packet_index < packet_count; packet_index++) {
+    record_packet(true, idx, buffer + (packet_index * USB_MIDI_PACKET_SIZE));
+  }
+
+  return packet_count * USB_MIDI_PACKET_SIZE;
+}
+
+uint32_t tuh_midi_write_flush(uint8_t idx) {
+  (void) idx;
+  return 0;
+}
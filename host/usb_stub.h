@@ -0,0 +1,52 @@
+#ifndef _USB_STUB_H_
+#define _USB_STUB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "launchpad.h"
+#include "tusb.h"
+
+// A stand-in for TinyUSB that records everything the Launchpad engine writes,
+// so that we can measure what it sends without any hardware attached.
+
+struct usb_stub_counters {
+    uint32_t bytes;
+    uint32_t packets;
+};
+
+// Called with every packet the engine writes, in the order it writes them.
+typedef void (*usb_stub_recorder)(void *context, bool is_host, uint8_t index, const uint8_t *packet);
+
+void usb_stub_reset_counters(void);
+
+struct usb_stub_counters usb_stub_get_client_counters(uint8_t);
+struct usb_stub_counters usb_stub_get_host_counters(uint8_t);
+
+void usb_stub_set_recorder(usb_stub_recorder, void*);
+
+// Queue a packet for tud_midi_packet_read or tuh_midi_packet_read to return.
+bool usb_stub_push_client_input(const uint8_t*);
+bool usb_stub_push_host_input(uint8_t, const uint8_t*);
+
+// By default, TinyUSB's transmit FIFOs never fill up, and time_us_32 reads
+// the real clock.  A simulation can instead give the FIFOs a size in bytes,
+// take packets out of them as the bus would, and set the time itself.
+#define USB_STUB_MAX_FIFO_PACKETS 4096
+
+void usb_stub_set_fifo_sizes(uint32_t, uint32_t);
+uint16_t usb_stub_take_client_packets(uint16_t, uint8_t*);
+uint16_t usb_stub_take_host_packets(uint8_t, uint16_t);
+uint16_t usb_stub_get_host_fifo_packets(uint8_t);
+
+void usb_stub_set_simulated_time(uint32_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _USB_STUB_H_ */
@@ -0,0 +1,172 @@
+#include <string.h>
+#include "animation.h"
+#include "palette.h"
+
+// Used when we're asked for an animation that never moves on.
+#define ANIMATION_DEFAULT_PERIOD_US 1000000
+
+static const uint8_t step_counts[] = {
+  [ANIMATION_NONE] = 1,
+  [ANIMATION_BLINK] = ANIMATION_BLINK_STEPS,
+  [ANIMATION_PULSE] = ANIMATION_PULSE_STEPS,
+  [ANIMATION_COLOUR_CYCLE] = ANIMATION_COLOUR_CYCLE_STEPS
+};
+
+// The effect that does the same thing on devices that can animate a pad by
+// themselves, if there is one.
+static const uint8_t native_effects[] = {
+  [ANIMATION_NONE] = 0,
+  [ANIMATION_BLINK] = LAUNCHPAD_EFFECT_FLASH,
+  [ANIMATION_PULSE] = LAUNCHPAD_EFFECT_PULSE,
+  [ANIMATION_COLOUR_CYCLE] = 0
+};
+
+static uint8_t animation_step(const struct animation *animation, uint32_t now) {
+  uint32_t elapsed = (now - animation->start_time) % animation->period_us;
+  return (uint8_t) (((uint64_t) elapsed * step_counts[animation->type]) / animation->period_us);
+}
+
+static struct led_colour scale_colour(struct led_colour colour, int numerator, int denominator) {
+  return (struct led_colour) {
+    (colour.red * numerator) / denominator,
+    (colour.green * numerator) / denominator,
+    (colour.blue * numerator) / denominator
+  };
+}
+
+// Six segments, each fading one channel up or down, starting from red.
+static struct led_colour colour_wheel(uint8_t step, uint8_t level) {
+  int steps_per_segment = ANIMATION_COLOUR_CYCLE_STEPS / 6;
+  uint8_t rising = ((step % steps_per_segment) * level) / steps_per_segment;
+  uint8_t falling = level - rising;
+
+  switch (step / steps_per_segment) {
+    case 0:
+      return (struct led_colour) { level, rising, 0 };
+    case 1:
+      return (struct led_colour) { falling, level, 0 };
+    case 2:
+      return (struct led_colour) { 0, level, rising };
+    case 3:
+      return (struct led_colour) { 0, falling, level };
+    case 4:
+      return (struct led_colour) { rising, 0, level };
+    default:
+      return (struct led_colour) { level, 0, falling };
+  }
+}
+
+// What the firmware shows for each step, for devices that can't do the
+// animation themselves.
+static struct led_colour colour_for_step(const struct animation *animation, uint8_t step) {
+  switch (animation->type) {
+    case ANIMATION_BLINK:
+      return step == 0 ? animation->colour : LED_COLOUR_BLACK;
+    case ANIMATION_PULSE: {
+      // Fade down from the full colour and back up again, without going out
+      // completely.
+      int half = ANIMATION_PULSE_STEPS / 2;
+      int distance = step <= half ? step : ANIMATION_PULSE_STEPS - step;
+      return scale_colour(animation->colour, half + 1 - distance, half + 1);
+    }
+    case ANIMATION_COLOUR_CYCLE: {
+      struct led_colour colour = animation->colour;
+      uint8_t level = colour.red > colour.green ? colour.red : colour.green;
+      level = colour.blue > level ? colour.blue : level;
+      return colour_wheel(step, level > 0 ? level : 127);
+    }
+    default:
+      return animation->colour;
+  }
+}
+
+void animator_start(struct animator *animator, int index, enum AnimationType type, struct led_colour colour, uint32_t period_us, uint32_t now) {
+  if (index < 0 || index >= LAUNCHPAD_GRID_CELLS) {
+    return;
+  }
+
+  if (type == ANIMATION_NONE) {
+    animator_stop(animator, index);
+    return;
+  }
+
+  struct animation *animation = &animator->cells[index];
+  if (animation->type == ANIMATION_NONE) {
+    animator->active_count++;
+  }
+
+  animation->type = type;
+  animation->colour = colour;
+  animation->palette_index = palette_index_for_colour(colour);
+  animation->period_us = period_us > 0 ? period_us : ANIMATION_DEFAULT_PERIOD_US;
+  animation->start_time = now;
+  animation->step = 0;
+
+  animator->is_changed = true;
+}
+
+void animator_stop(struct animator *animator, int index) {
+  if (index < 0 || index >= LAUNCHPAD_GRID_CELLS) {
+    return;
+  }
+
+  struct animation *animation = &animator->cells[index];
+  if (animation->type == ANIMATION_NONE) {
+    return;
+  }
+
+  animation->type = ANIMATION_NONE;
+  animator->active_count--;
+  animator->is_changed = true;
+}
+
+void animator_stop_all(struct animator *animator) {
+  for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+    animator_stop(animator, index);
+  }
+}
+
+// Whether any animation has moved on to its next step since the last frame.
+bool animator_needs_frame(const struct animator *animator, uint32_t now) {
+  if (animator->is_changed) {
+    return true;
+  }
+
+  if (animator->active_count == 0) {
+    return false;
+  }
+
+  for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+    const struct animation *animation = &animator->cells[index];
+    if (animation->type != ANIMATION_NONE && animation_step(animation, now) != animation->step) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Draw every animated cell over whatever the frame already has, and mark the
+// ones that devices can animate themselves.
+void animator_apply(struct animator *animator, struct led_frame *frame, uint32_t now) {
+  memset(frame->effects, 0, sizeof(frame->effects));
+  memset(frame->effect_colours, 0, sizeof(frame->effect_colours));
+  animator->is_changed = false;
+
+  if (animator->active_count == 0) {
+    return;
+  }
+
+  for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+    struct animation *animation = &animator->cells[index];
+    if (animation->type == ANIMATION_NONE) {
+      continue;
+    }
+
+    animation->step = animation_step(animation, now);
+
+    frame->cells[index] = colour_for_step(animation, animation->step);
+    frame->effects[index] = native_effects[animation->type];
+    frame->effect_colours[index] = animation->palette_index;
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef _ANIMATION_H_
+#define _ANIMATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "launchpad.h"
+
+// Pads that blink, pulse or cycle through colours by themselves, drawn on top
+// of everything else in the frame.
+//
+// Where a device can flash or pulse a pad by itself, we tell it to once, and
+// leave it to get on with it, see led_frame.  Everything else is timed by the
+// firmware: the frame is drawn again each time an animation moves on to its
+// next step, and devices that can't do the animation themselves are sent the
+// new colour.  Devices that can have nothing to update, and aren't sent
+// anything.
+//
+// Devices that run an animation themselves use their own timing, which
+// follows MIDI clock if they have one and 120 BPM otherwise, rather than the
+// period we're asked for.
+
+enum AnimationType {
+  ANIMATION_NONE = 0,
+  // Switch between the colour and black.
+  ANIMATION_BLINK,
+  // Fade the colour up and down.
+  ANIMATION_PULSE,
+  // Go round the colour wheel, as bright as the colour.  No model can do this
+  // by itself.
+  ANIMATION_COLOUR_CYCLE
+};
+
+// How many different colours the firmware shows in each period.
+#define ANIMATION_BLINK_STEPS 2
+#define ANIMATION_PULSE_STEPS 16
+#define ANIMATION_COLOUR_CYCLE_STEPS 24
+
+struct animation {
+    uint8_t type;
+    struct led_colour colour;
+
+    // The closest palette colour, for devices that animate the pad themselves.
+    uint8_t palette_index;
+
+    uint32_t period_us;
+    uint32_t start_time;
+
+    // The step we last drew.
+    uint8_t step;
+};
+
+// All zeros is a valid animator with nothing animated.
+struct animator {
+    struct animation cells[LAUNCHPAD_GRID_CELLS];
+    uint8_t active_count;
+
+    // An animation has been started or stopped since the last frame.
+    bool is_changed;
+};
+
+void animator_start(struct animator*, int, enum AnimationType, struct led_colour, uint32_t, uint32_t);
+
+void animator_stop(struct animator*, int);
+
+void animator_stop_all(struct animator*);
+
+bool animator_needs_frame(const struct animator*, uint32_t);
+
+void animator_apply(struct animator*, struct led_frame*, uint32_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ANIMATION_H_ */
@@ -0,0 +1,122 @@
+#include <string.h>
+#include "compositor.h"
+
+static void mark_dirty(struct compositor *compositor, int index) {
+  uint32_t bit = 1u << (index % 32);
+  if ((compositor->dirty[index / 32] & bit) == 0) {
+    compositor->dirty[index / 32] |= bit;
+    compositor->dirty_count++;
+  }
+}
+
+// Cells that are transparent don't change the picture, however they change.
+static void mark_layer_dirty(struct compositor *compositor, enum CompositorLayer layer) {
+  for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+    if (compositor->layers[layer].alphas[index] != COMPOSITOR_TRANSPARENT) {
+      mark_dirty(compositor, index);
+    }
+  }
+}
+
+void compositor_set_cell(struct compositor *compositor, enum CompositorLayer layer, int index, struct led_colour colour, uint8_t alpha) {
+  if (layer >= COMPOSITOR_LAYER_COUNT || index < 0 || index >= LAUNCHPAD_GRID_CELLS) {
+    return;
+  }
+
+  struct compositor_layer *target = &compositor->layers[layer];
+
+  // Nothing has changed on this layer.  We don't look at the layers above,
+  // see compositor.h.
+  if (alpha == target->alphas[index] && (alpha == COMPOSITOR_TRANSPARENT || led_colour_equals(colour, target->colours[index]))) {
+    return;
+  }
+
+  target->colours[index] = colour;
+  target->alphas[index] = alpha;
+
+  if (!target->is_hidden) {
+    mark_dirty(compositor, index);
+  }
+}
+
+void compositor_clear_layer(struct compositor *compositor, enum CompositorLayer layer) {
+  if (layer >= COMPOSITOR_LAYER_COUNT) {
+    return;
+  }
+
+  if (!compositor->layers[layer].is_hidden) {
+    mark_layer_dirty(compositor, layer);
+  }
+
+  memset(compositor->layers[layer].alphas, COMPOSITOR_TRANSPARENT, sizeof(compositor->layers[layer].alphas));
+}
+
+void compositor_set_layer_blend(struct compositor *compositor, enum CompositorLayer layer, enum CompositorBlend blend) {
+  if (layer >= COMPOSITOR_LAYER_COUNT) {
+    return;
+  }
+
+  if (compositor->layers[layer].blend != blend) {
+    compositor->layers[layer].blend = blend;
+    mark_layer_dirty(compositor, layer);
+  }
+}
+
+void compositor_set_layer_hidden(struct compositor *compositor, enum CompositorLayer layer, bool is_hidden) {
+  if (layer >= COMPOSITOR_LAYER_COUNT) {
+    return;
+  }
+
+  if (compositor->layers[layer].is_hidden != is_hidden) {
+    compositor->layers[layer].is_hidden = is_hidden;
+    mark_layer_dirty(compositor, layer);
+  }
+}
+
+static inline uint8_t blend_channel(uint8_t below, uint8_t above, uint8_t alpha) {
+  return ((above * alpha) + (below * (COMPOSITOR_OPAQUE - alpha)) + (COMPOSITOR_OPAQUE / 2)) / COMPOSITOR_OPAQUE;
+}
+
+static struct led_colour compose_cell(const struct compositor *compositor, int index) {
+  struct led_colour colour = LED_COLOUR_BLACK;
+
+  for (int layer_index = 0; layer_index < COMPOSITOR_LAYER_COUNT; layer_index++) {
+    const struct compositor_layer *layer = &compositor->layers[layer_index];
+    uint8_t alpha = layer->alphas[index];
+    if (layer->is_hidden || alpha == COMPOSITOR_TRANSPARENT) {
+      continue;
+    }
+
+    struct led_colour above = layer->blend == COMPOSITOR_BLEND_MASK ? LED_COLOUR_BLACK : layer->colours[index];
+    if (alpha == COMPOSITOR_OPAQUE) {
+      colour = above;
+    }
+    else {
+      colour.red = blend_channel(colour.red, above.red, alpha);
+      colour.green = blend_channel(colour.green, above.green, alpha);
+      colour.blue = blend_channel(colour.blue, above.blue, alpha);
+    }
+  }
+
+  return colour;
+}
+
+// Work out every cell that has changed, and copy the whole picture into
+// `frame`.  Returns the number of cells we had to work out.
+int compositor_compose(struct compositor *compositor, struct led_frame *frame) {
+  int composed_count = compositor->dirty_count;
+
+  for (int word = 0; word < COMPOSITOR_DIRTY_WORDS; word++) {
+    uint32_t bits = compositor->dirty[word];
+    while (bits) {
+      int index = (word * 32) + __builtin_ctz(bits);
+      compositor->composed[index] = compose_cell(compositor, index);
+      bits &= bits - 1;
+    }
+    compositor->dirty[word] = 0;
+  }
+  compositor->dirty_count = 0;
+
+  memcpy(frame->cells, compositor->composed, sizeof(frame->cells));
+  return composed_count;
+}
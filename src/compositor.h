@@ -0,0 +1,82 @@
+#ifndef _COMPOSITOR_H_
+#define _COMPOSITOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "launchpad.h"
+
+// Builds each frame from a stack of layers, drawn from the bottom up over
+// black.  Each cell of a layer has a colour and an alpha, where 0 leaves
+// whatever is underneath alone and COMPOSITOR_OPAQUE covers it completely.
+//
+// We keep track of which cells have changed in any layer since the last frame,
+// and only work those cells out again, so a frame costs about the same however
+// many layers there are.  A change that's covered up by a layer above still
+// counts, so a dirty cell may come out the same colour as before.  That's
+// fine, as the device encoders compare the whole frame with what each device
+// is showing, and only send the cells that differ.
+
+enum CompositorLayer {
+  COMPOSITOR_LAYER_BACKGROUND,
+  COMPOSITOR_LAYER_CURSOR,
+  COMPOSITOR_LAYER_OVERLAY,
+  COMPOSITOR_LAYER_NOTIFICATION,
+  COMPOSITOR_LAYER_COUNT
+};
+
+enum CompositorBlend {
+  // Mix the layer's colour with what's underneath.
+  COMPOSITOR_BLEND_ALPHA,
+  // Darken what's underneath, ignoring the layer's colour, e.g. to hide part
+  // of the grid behind a notification.
+  COMPOSITOR_BLEND_MASK
+};
+
+#define COMPOSITOR_TRANSPARENT 0
+#define COMPOSITOR_OPAQUE 255
+
+#define COMPOSITOR_DIRTY_WORDS ((LAUNCHPAD_GRID_CELLS + 31) / 32)
+
+struct compositor_layer {
+    struct led_colour colours[LAUNCHPAD_GRID_CELLS];
+    uint8_t alphas[LAUNCHPAD_GRID_CELLS];
+    uint8_t blend;
+    bool is_hidden;
+};
+
+// All zeros is a valid, empty compositor, where every layer is transparent.
+struct compositor {
+    struct compositor_layer layers[COMPOSITOR_LAYER_COUNT];
+
+    // What the layers looked like when we last put them together.
+    struct led_colour composed[LAUNCHPAD_GRID_CELLS];
+
+    // One bit for each cell that has to be worked out again.
+    uint32_t dirty[COMPOSITOR_DIRTY_WORDS];
+    uint8_t dirty_count;
+};
+
+void compositor_set_cell(struct compositor*, enum CompositorLayer, int, struct led_colour, uint8_t);
+
+void compositor_clear_layer(struct compositor*, enum CompositorLayer);
+
+void compositor_set_layer_blend(struct compositor*, enum CompositorLayer, enum CompositorBlend);
+
+void compositor_set_layer_hidden(struct compositor*, enum CompositorLayer, bool);
+
+static inline bool compositor_is_dirty(const struct compositor *compositor) {
+    return compositor->dirty_count > 0;
+}
+
+int compositor_compose(struct compositor*, struct led_frame*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _COMPOSITOR_H_ */
@@ -0,0 +1,95 @@
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include "device_cache.h"
+
+static struct device_cache_entry entries[DEVICE_CACHE_ENTRIES];
+
+// Odd while core1 is changing an entry, and bumped again once it's done, so
+// that core0 can tell if its copy was taken part way through a change.
+static atomic_uint version = 0;
+
+// When the cache is full, we replace entries in the order they were added.
+static uint8_t next_entry = 0;
+
+// FNV-1a over the UTF-16 characters of a serial number string.  We never get
+// a hash of 0 for a real serial number, so that can mean "none".
+uint32_t device_cache_hash_serial(const uint16_t *characters, uint16_t length) {
+  if (length == 0) {
+    return 0;
+  }
+
+  uint32_t hash = 2166136261u;
+  for (uint16_t index = 0; index < length; index++) {
+    hash ^= characters[index] & 0xFF;
+    hash *= 16777619u;
+    hash ^= characters[index] >> 8;
+    hash *= 16777619u;
+  }
+
+  return hash == 0 ? 1 : hash;
+}
+
+static struct device_cache_entry *find_entry(uint16_t id_vendor, uint16_t id_product, uint32_t serial_hash) {
+  for (int index = 0; index < DEVICE_CACHE_ENTRIES; index++) {
+    struct device_cache_entry *entry = &entries[index];
+    if (entry->is_valid && entry->id_vendor == id_vendor && entry->id_product == id_product && entry->serial_hash == serial_hash) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+bool device_cache_lookup(uint16_t id_vendor, uint16_t id_product, uint32_t serial_hash, enum LaunchpadModel *model) {
+  const struct device_cache_entry *entry = find_entry(id_vendor, id_product, serial_hash);
+  if (entry == NULL) {
+    return false;
+  }
+
+  *model = entry->model;
+  return true;
+}
+
+void device_cache_store(uint16_t id_vendor, uint16_t id_product, uint32_t serial_hash, enum LaunchpadModel model) {
+  atomic_fetch_add_explicit(&version, 1, memory_order_acq_rel);
+
+  struct device_cache_entry *entry = find_entry(id_vendor, id_product, serial_hash);
+  if (entry == NULL) {
+    entry = &entries[next_entry];
+    next_entry = (next_entry + 1) % DEVICE_CACHE_ENTRIES;
+  }
+
+  entry->is_valid = true;
+  entry->id_vendor = id_vendor;
+  entry->id_product = id_product;
+  entry->serial_hash = serial_hash;
+  entry->model = model;
+
+  atomic_fetch_add_explicit(&version, 1, memory_order_release);
+}
+
+// Copy every entry into `copy`, which must have room for DEVICE_CACHE_ENTRIES.
+// Entries only change when a device is plugged in, so we rarely have to try
+// again.
+void device_cache_export(struct device_cache_entry *copy) {
+  unsigned int before;
+  unsigned int after;
+  do {
+    before = atomic_load_explicit(&version, memory_order_acquire);
+    memcpy(copy, entries, sizeof(entries));
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&version, memory_order_relaxed);
+  } while ((before & 1) != 0 || before != after);
+}
+
+// Only call this before the host stack starts.
+void device_cache_import(const struct device_cache_entry *saved) {
+  memcpy(entries, saved, sizeof(entries));
+
+  for (int index = 0; index < DEVICE_CACHE_ENTRIES; index++) {
+    if (entries[index].model >= LAUNCHPAD_MODEL_COUNT) {
+      entries[index].is_valid = false;
+    }
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef _DEVICE_CACHE_H_
+#define _DEVICE_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device_profile.h"
+
+// Remembers which model each device that answered a device inquiry turned out
+// to be, keyed by its vendor and product IDs and a hash of its serial number,
+// so that a device that's plugged in again doesn't have to be asked again.  Only
+// the host stack (core1) looks up and stores entries, core0 takes a copy of
+// the whole cache to save, see device_cache_export.
+
+#define DEVICE_CACHE_ENTRIES 8
+
+struct device_cache_entry {
+    bool is_valid;
+    uint16_t id_vendor;
+    uint16_t id_product;
+
+    // See device_cache_hash_serial, 0 for devices without a serial number.
+    uint32_t serial_hash;
+
+    uint8_t model;
+};
+
+uint32_t device_cache_hash_serial(const uint16_t*, uint16_t);
+
+bool device_cache_lookup(uint16_t, uint16_t, uint32_t, enum LaunchpadModel*);
+
+void device_cache_store(uint16_t, uint16_t, uint32_t, enum LaunchpadModel);
+
+void device_cache_export(struct device_cache_entry*);
+
+void device_cache_import(const struct device_cache_entry*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DEVICE_CACHE_H_ */
@@ -0,0 +1,54 @@
+#include <stddef.h>
+#include <string.h>
+#include "device_inquiry.h"
+#include "sysex_assembler.h"
+
+const uint8_t device_inquiry_request[DEVICE_INQUIRY_REQUEST_LENGTH] = { 0xF0, 0x7E, 0x7F, 0x06, 0x01, 0xF7 };
+
+static const uint8_t universal_non_realtime_header[] = { 0xF0, 0x7E };
+
+static device_inquiry_callback on_reply = NULL;
+
+bool parse_device_inquiry_reply(const uint8_t *message, uint16_t length, struct device_inquiry_reply *reply) {
+  // Everything up to the manufacturer.
+  if (length < 6 || message[0] != 0xF0 || message[1] != 0x7E || message[3] != 0x06 || message[4] != 0x02) {
+    return false;
+  }
+
+  reply->device_id = message[2];
+
+  uint16_t offset = 5;
+  reply->manufacturer_id_length = message[offset] == 0x00 ? 3 : 1;
+
+  // The manufacturer, family, member, version and F7h.
+  if (length != offset + reply->manufacturer_id_length + 2 + 2 + 4 + 1) {
+    return false;
+  }
+
+  memset(reply->manufacturer_id, 0, sizeof(reply->manufacturer_id));
+  memcpy(reply->manufacturer_id, message + offset, reply->manufacturer_id_length);
+  offset += reply->manufacturer_id_length;
+
+  // We keep the two bytes as they are rather than joining them up into a 14
+  // bit number, so that codes like Novation's 23h 01h come out as 0123h.
+  reply->family_code = message[offset] | (message[offset + 1] << 8);
+  reply->member_code = message[offset + 2] | (message[offset + 3] << 8);
+  memcpy(reply->version, message + offset + 4, sizeof(reply->version));
+
+  return true;
+}
+
+static void handle_universal_sysex(struct midi_endpoint source, const uint8_t *message, uint16_t length) {
+  struct device_inquiry_reply reply;
+  if (on_reply == NULL || !parse_device_inquiry_reply(message, length, &reply)) {
+    return;
+  }
+
+  enum LaunchpadModel model = find_inquiry_model(reply.manufacturer_id, reply.manufacturer_id_length, reply.family_code);
+  on_reply(source, model, &reply);
+}
+
+void initialise_device_inquiry(device_inquiry_callback callback) {
+  on_reply = callback;
+  sysex_assembler_register_handler(universal_non_realtime_header, sizeof(universal_non_realtime_header), handle_universal_sysex);
+}
@@ -0,0 +1,51 @@
+#ifndef _DEVICE_INQUIRY_H_
+#define _DEVICE_INQUIRY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device_profile.h"
+#include "midi_router.h"
+
+// Identifies devices with the MIDI Universal Device Inquiry:
+//
+//   F0h 7Eh 7Fh 06h 01h F7h
+//
+// Devices that support it reply with:
+//
+//   F0h 7Eh <device> 06h 02h <manufacturer> <family> <member> <version> F7h
+//
+// where the manufacturer is one byte, or 00h and two more bytes, the family
+// and member codes are two bytes each, least significant first, and the
+// version is four bytes.
+
+#define DEVICE_INQUIRY_REQUEST_LENGTH 6
+
+extern const uint8_t device_inquiry_request[DEVICE_INQUIRY_REQUEST_LENGTH];
+
+struct device_inquiry_reply {
+    uint8_t device_id;
+    uint8_t manufacturer_id[3];
+    uint8_t manufacturer_id_length;
+    uint16_t family_code;
+    uint16_t member_code;
+    uint8_t version[4];
+};
+
+bool parse_device_inquiry_reply(const uint8_t*, uint16_t, struct device_inquiry_reply*);
+
+// Called for every reply, with the model it identifies, which may be
+// LAUNCHPAD_MODEL_UNKNOWN.
+typedef void (*device_inquiry_callback)(struct midi_endpoint source, enum LaunchpadModel model, const struct device_inquiry_reply *reply);
+
+void initialise_device_inquiry(device_inquiry_callback);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DEVICE_INQUIRY_H_ */
@@ -0,0 +1,202 @@
+#include <stddef.h>
+#include <string.h>
+#include "device_profile.h"
+#include "launchpad.h"
+
+#define NOVATION_VENDOR_ID 0x1235
+
+static const uint8_t novation_manufacturer_id[] = { 0x00, 0x20, 0x29 };
+
+// MK1 (Launchpad S)
+//
+// Change the button layout:
+// Host » Launchpad: Channel 1: controller 0 set to 1 or 2.
+//  B0h, 00h, 01-02h (176, 0, 1-2).
+//
+// Then display buffer 0 while we draw the first frame, in buffer 1 if we're
+// double buffering, see write_mk1_buffer_control.
+static const uint8_t launchpad_s_init_sequence[] = {
+  0xB0, 0x00, 0x01,
+#if MK1_DOUBLE_BUFFERED
+  0xB0, 0x00, 32 + 4
+#else
+  0xB0, 0x00, 32
+#endif
+};
+
+// MK2 (Launchpad Pro)
+//
+// Select "standalone" mode (it's the default, but for users who also use
+// Ableton, this will ensure things are set up properly), then the
+// "programmer" layout ("note" layout is the default).
+static const uint8_t launchpad_pro_mk2_init_sequence[] = {
+  0xF0, 0x00, 0x20, 0x29, 0x02, 0x10, 0x2C, 0x03, 0xF7,
+  0xF0, 0x00, 0x20, 0x29, 0x02, 0x10, 0x16, 0x03, 0xF7
+};
+
+// MK3 (Launchpad Pro MK3)
+//
+// Select the programmer's layout, we want layout 11h and page 0
+// F0h 00h 20h 29h 02h 0Eh 00h <layout> <page> 00h F7h
+//
+// They don't have a "clear all" method, just a sysex to send a value for
+// every pad, so we skip that.
+static const uint8_t launchpad_pro_mk3_init_sequence[] = {
+  0xF0, 0x00, 0x20, 0x29, 0x02, 0x0E, 0x00, 0x11, 0x00, 0x00, 0xF7
+};
+
+// The Launchpad X and Mini MK3 switch to programmer mode with:
+// F0h 00h 20h 29h 02h <model> 0Eh 01h F7h
+static const uint8_t launchpad_x_init_sequence[] = {
+  0xF0, 0x00, 0x20, 0x29, 0x02, 0x0C, 0x0E, 0x01, 0xF7
+};
+
+static const uint8_t launchpad_mini_mk3_init_sequence[] = {
+  0xF0, 0x00, 0x20, 0x29, 0x02, 0x0D, 0x0E, 0x01, 0xF7
+};
+
+// The product ID ranges allow for the device ID that can be set on each unit,
+// so that several of the same model can be told apart.
+//
+// The MK2 and MK3 can flash and pulse pads by themselves.  The MK1 can only
+// flash by switching between its two buffers, which we use for double
+// buffering, so the firmware animates its pads instead.
+//
+// The MK2 has "Live", "Standalone" and "MIDI" ports, and wants the second.
+// The Pro MK3 has "MIDI", "DIN" and "DAW" ports, and wants the first.  The X
+// and Mini MK3 have "DAW" and "MIDI" ports, and want the second.
+static const struct device_profile device_profiles[LAUNCHPAD_MODEL_COUNT] = {
+  [LAUNCHPAD_MODEL_UNKNOWN] = {
+    .name = "Unknown",
+    .launchpad_version = UNkNOWN
+  },
+  [LAUNCHPAD_MODEL_S] = {
+    .name = "Launchpad S",
+    .launchpad_version = MK1,
+    .note_layout = LAUNCHPAD_LAYOUT_XY,
+    .id_vendor = NOVATION_VENDOR_ID,
+    .first_product_id = 0x000E,
+    .last_product_id = 0x000E,
+    .host_cable = 0,
+    .init_sequence = launchpad_s_init_sequence,
+    .init_sequence_length = sizeof(launchpad_s_init_sequence),
+    .encodings = LAUNCHPAD_ENCODING_RAPID_UPDATE,
+    .controls = {
+      [104] = LAUNCHPAD_CONTROL_UP,
+      [105] = LAUNCHPAD_CONTROL_DOWN,
+      [106] = LAUNCHPAD_CONTROL_LEFT,
+      [107] = LAUNCHPAD_CONTROL_RIGHT
+    }
+  },
+  [LAUNCHPAD_MODEL_PRO_MK2] = {
+    .name = "Launchpad Pro",
+    .launchpad_version = MK2,
+    .note_layout = LAUNCHPAD_LAYOUT_PROGRAMMER,
+    .id_vendor = NOVATION_VENDOR_ID,
+    .first_product_id = 0x0051,
+    .last_product_id = 0x0060,
+    .host_cable = 1,
+    .sysex_model_id = 0x10,
+    .init_sequence = launchpad_pro_mk2_init_sequence,
+    .init_sequence_length = sizeof(launchpad_pro_mk2_init_sequence),
+    .encodings = LAUNCHPAD_ENCODING_RGB_GRID,
+    .effects = LAUNCHPAD_EFFECT_FLASH | LAUNCHPAD_EFFECT_PULSE,
+    .controls = {
+      [91] = LAUNCHPAD_CONTROL_UP,
+      [92] = LAUNCHPAD_CONTROL_DOWN,
+      [93] = LAUNCHPAD_CONTROL_LEFT,
+      [94] = LAUNCHPAD_CONTROL_RIGHT
+    }
+  },
+  [LAUNCHPAD_MODEL_PRO_MK3] = {
+    .name = "Launchpad Pro MK3",
+    .launchpad_version = MK3,
+    .note_layout = LAUNCHPAD_LAYOUT_PROGRAMMER,
+    .id_vendor = NOVATION_VENDOR_ID,
+    .first_product_id = 0x0123,
+    .last_product_id = 0x0132,
+    .host_cable = 0,
+    .sysex_model_id = 0x0E,
+    .init_sequence = launchpad_pro_mk3_init_sequence,
+    .init_sequence_length = sizeof(launchpad_pro_mk3_init_sequence),
+    .encodings = LAUNCHPAD_ENCODING_PALETTE_NOTES,
+    .effects = LAUNCHPAD_EFFECT_FLASH | LAUNCHPAD_EFFECT_PULSE,
+    .controls = {
+      [80] = LAUNCHPAD_CONTROL_UP,
+      [70] = LAUNCHPAD_CONTROL_DOWN,
+      [91] = LAUNCHPAD_CONTROL_LEFT,
+      [92] = LAUNCHPAD_CONTROL_RIGHT
+    }
+  },
+  [LAUNCHPAD_MODEL_X] = {
+    .name = "Launchpad X",
+    .launchpad_version = MK3,
+    .note_layout = LAUNCHPAD_LAYOUT_PROGRAMMER,
+    .id_vendor = NOVATION_VENDOR_ID,
+    .first_product_id = 0x0103,
+    .last_product_id = 0x0112,
+    .host_cable = 1,
+    .sysex_model_id = 0x0C,
+    .init_sequence = launchpad_x_init_sequence,
+    .init_sequence_length = sizeof(launchpad_x_init_sequence),
+    .encodings = LAUNCHPAD_ENCODING_PALETTE_NOTES,
+    .effects = LAUNCHPAD_EFFECT_FLASH | LAUNCHPAD_EFFECT_PULSE,
+    .controls = {
+      [91] = LAUNCHPAD_CONTROL_UP,
+      [92] = LAUNCHPAD_CONTROL_DOWN,
+      [93] = LAUNCHPAD_CONTROL_LEFT,
+      [94] = LAUNCHPAD_CONTROL_RIGHT
+    }
+  },
+  [LAUNCHPAD_MODEL_MINI_MK3] = {
+    .name = "Launchpad Mini MK3",
+    .launchpad_version = MK3,
+    .note_layout = LAUNCHPAD_LAYOUT_PROGRAMMER,
+    .id_vendor = NOVATION_VENDOR_ID,
+    .first_product_id = 0x0113,
+    .last_product_id = 0x0122,
+    .host_cable = 1,
+    .sysex_model_id = 0x0D,
+    .init_sequence = launchpad_mini_mk3_init_sequence,
+    .init_sequence_length = sizeof(launchpad_mini_mk3_init_sequence),
+    .encodings = LAUNCHPAD_ENCODING_PALETTE_NOTES,
+    .effects = LAUNCHPAD_EFFECT_FLASH | LAUNCHPAD_EFFECT_PULSE,
+    .controls = {
+      [91] = LAUNCHPAD_CONTROL_UP,
+      [92] = LAUNCHPAD_CONTROL_DOWN,
+      [93] = LAUNCHPAD_CONTROL_LEFT,
+      [94] = LAUNCHPAD_CONTROL_RIGHT
+    }
+  }
+};
+
+const struct device_profile *get_device_profile(enum LaunchpadModel model) {
+  if (model >= LAUNCHPAD_MODEL_COUNT) {
+    model = LAUNCHPAD_MODEL_UNKNOWN;
+  }
+
+  return &device_profiles[model];
+}
+
+// Only called when a device is connected, so a search is fine here.
+enum LaunchpadModel find_device_model(uint16_t idVendor, uint16_t idProduct) {
+  for (int model = LAUNCHPAD_MODEL_UNKNOWN + 1; model < LAUNCHPAD_MODEL_COUNT; model++) {
+    const struct device_profile *profile = &device_profiles[model];
+    if (idVendor == profile->id_vendor && idProduct >= profile->first_product_id && idProduct <= profile->last_product_id) {
+      return model;
+    }
+  }
+
+  return LAUNCHPAD_MODEL_UNKNOWN;
+}
+
+// Novation's sysex models answer a device inquiry with their USB product ID as
+// the family code, so we can use the same ranges.  The MK1 doesn't answer at
+// all.
+enum LaunchpadModel find_inquiry_model(const uint8_t *manufacturer_id, uint8_t manufacturer_id_length, uint16_t family_code) {
+  if (manufacturer_id_length != sizeof(novation_manufacturer_id) || memcmp(manufacturer_id, novation_manufacturer_id, sizeof(novation_manufacturer_id)) != 0) {
+    return LAUNCHPAD_MODEL_UNKNOWN;
+  }
+
+  return find_device_model(NOVATION_VENDOR_ID, family_code);
+}
@@ -0,0 +1,103 @@
+#ifndef _DEVICE_PROFILE_H_
+#define _DEVICE_PROFILE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// Everything we need to know to work with a particular Launchpad model lives
+// in a single row of the profile table in device_profile.c, so that supporting
+// a new model means adding a row rather than another set of functions.
+
+// The generation a model belongs to, which decides how we encode frames for it.
+enum LaunchpadVersion {
+  UNkNOWN,
+  MK1,
+  MK2,
+  MK3
+};
+
+// The models we know about.  These are also the indices into the profile table.
+enum LaunchpadModel {
+  LAUNCHPAD_MODEL_UNKNOWN = 0,
+  LAUNCHPAD_MODEL_S,
+  LAUNCHPAD_MODEL_PRO_MK2,
+  LAUNCHPAD_MODEL_PRO_MK3,
+  LAUNCHPAD_MODEL_X,
+  LAUNCHPAD_MODEL_MINI_MK3,
+  LAUNCHPAD_MODEL_COUNT
+};
+
+// How the model numbers its pads.
+enum LaunchpadNoteLayout {
+  // The MK1 "X-Y" layout, where the pad at a given row and column is
+  // (row * 16) + column, counting from the top left.
+  LAUNCHPAD_LAYOUT_XY,
+  // The "programmer" layout, which matches our own grid.
+  LAUNCHPAD_LAYOUT_PROGRAMMER
+};
+
+// What pressing a control does to the board.
+enum LaunchpadControl {
+  LAUNCHPAD_CONTROL_NONE = 0,
+  LAUNCHPAD_CONTROL_UP,
+  LAUNCHPAD_CONTROL_DOWN,
+  LAUNCHPAD_CONTROL_LEFT,
+  LAUNCHPAD_CONTROL_RIGHT,
+  LAUNCHPAD_CONTROL_COUNT
+};
+
+// Optional ways of painting a frame, beyond the basics every model in a
+// generation supports.
+#define LAUNCHPAD_ENCODING_RAPID_UPDATE   0x01 // MK1: two pads per message on channel 3.
+#define LAUNCHPAD_ENCODING_RGB_GRID       0x02 // MK2: set a whole grid in one message.
+#define LAUNCHPAD_ENCODING_PALETTE_NOTES  0x04 // MK3: set palette colours with note ons.
+
+// Animations a model can run on a pad by itself, see led_frame.
+#define LAUNCHPAD_EFFECT_FLASH  0x01
+#define LAUNCHPAD_EFFECT_PULSE  0x02
+
+#define LAUNCHPAD_MAX_CONTROLS 128
+
+struct device_profile {
+    const char *name;
+    enum LaunchpadVersion launchpad_version;
+    enum LaunchpadNoteLayout note_layout;
+
+    // The USB IDs the model shows up with, inclusive.
+    uint16_t id_vendor;
+    uint16_t first_product_id;
+    uint16_t last_product_id;
+
+    // The cable to talk to when the model is attached to the host port.
+    uint8_t host_cable;
+
+    // The byte after the Novation manufacturer ID and 02h in every sysex
+    // message, which identifies the model.  The MK1 doesn't use sysex.
+    uint8_t sysex_model_id;
+
+    // What we send when the device is first connected, usually to put it in
+    // the programmer layout.
+    const uint8_t *init_sequence;
+    uint16_t init_sequence_length;
+
+    uint8_t encodings;
+    uint8_t effects;
+
+    // What each controller number does, indexed by controller.
+    uint8_t controls[LAUNCHPAD_MAX_CONTROLS];
+};
+
+const struct device_profile *get_device_profile(enum LaunchpadModel);
+
+enum LaunchpadModel find_device_model(uint16_t, uint16_t);
+
+enum LaunchpadModel find_inquiry_model(const uint8_t*, uint8_t, uint16_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DEVICE_PROFILE_H_ */
@@ -0,0 +1,79 @@
+#include <string.h>
+#include "diagnostics.h"
+#include "launchpad.h"
+#include "packet_queue.h"
+#include "sysex_assembler.h"
+#include "tusb.h"
+
+_Static_assert(DIAGNOSTICS_CABLE < CFG_TUD_MIDI_NUMCABLES_OUT, "DIAGNOSTICS_CABLE should be one of our client cables");
+
+static const uint8_t diagnostics_header[] = { 0xF0, 0x7D, 0x50, 0x4C };
+
+#define DIAGNOSTICS_COUNTERS (8 + PACKET_QUEUE_LATENCY_BUCKETS)
+
+// Header, command, side and index, the counters, and the footer.
+#define DIAGNOSTICS_REPLY_LENGTH (sizeof(diagnostics_header) + 3 + (DIAGNOSTICS_COUNTERS * 5) + 1)
+
+static void append_counter(uint8_t *buffer, size_t *length, uint32_t counter) {
+  for (int byte_index = 0; byte_index < 5; byte_index++) {
+    buffer[(*length)++] = counter & 0x7F;
+    counter >>= 7;
+  }
+}
+
+static void write_stats_reply(uint8_t side, uint8_t index, const struct packet_queue_stats *stats) {
+  uint8_t reply[DIAGNOSTICS_REPLY_LENGTH];
+  size_t length = 0;
+
+  memcpy(reply, diagnostics_header, sizeof(diagnostics_header));
+  length += sizeof(diagnostics_header);
+  reply[length++] = DIAGNOSTICS_STATS_REPLY;
+  reply[length++] = side;
+  reply[length++] = index;
+
+  append_counter(reply, &length, stats->frames_sent);
+  append_counter(reply, &length, stats->bytes_sent);
+  append_counter(reply, &length, stats->dropped_messages);
+  append_counter(reply, &length, stats->dropped_packets);
+  append_counter(reply, &length, stats->high_water_mark);
+  append_counter(reply, &length, stats->last_frame_latency);
+  append_counter(reply, &length, stats->max_frame_latency);
+  append_counter(reply, &length, stats->mean_frame_latency);
+  for (int bucket = 0; bucket < PACKET_QUEUE_LATENCY_BUCKETS; bucket++) {
+    append_counter(reply, &length, stats->latency_histogram[bucket]);
+  }
+
+  reply[length++] = 0xF7;
+
+  write_client_message(DIAGNOSTICS_CABLE, reply, length);
+}
+
+// The host counters belong to core1, which publishes a consistent copy of
+// them for us, see get_host_queue_stats.
+static void write_all_stats(void) {
+  for (uint8_t cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    struct packet_queue_stats stats = get_client_queue_stats(cable);
+    write_stats_reply(0, cable, &stats);
+  }
+
+  for (uint8_t client_idx = 0; client_idx < MAX_HOST_LAUNCHPADS; client_idx++) {
+    struct packet_queue_stats stats = get_host_queue_stats(client_idx);
+    write_stats_reply(1, client_idx, &stats);
+  }
+}
+
+// Only answer requests on the diagnostics cable, so that nothing we forward
+// from other devices can trigger a reply.
+static void handle_diagnostics_sysex(struct midi_endpoint source, const uint8_t *message, uint16_t length) {
+  if (source.type != MIDI_ENDPOINT_CLIENT || source.index != DIAGNOSTICS_CABLE) {
+    return;
+  }
+
+  if (length == sizeof(diagnostics_header) + 2 && message[sizeof(diagnostics_header)] == DIAGNOSTICS_QUERY_STATS) {
+    write_all_stats();
+  }
+}
+
+void initialise_diagnostics(void) {
+  sysex_assembler_register_handler(diagnostics_header, sizeof(diagnostics_header), handle_diagnostics_sysex);
+}
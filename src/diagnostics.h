@@ -0,0 +1,42 @@
+#ifndef _DIAGNOSTICS_H_
+#define _DIAGNOSTICS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+// The last client cable is reserved for diagnostics.  Sending it this sysex
+// message:
+//
+//   F0h 7Dh 50h 4Ch 01h F7h
+//
+// gets back one reply for each client cable and host device:
+//
+//   F0h 7Dh 50h 4Ch 02h <side> <index> <counter> [ <counter> [...] ] F7h
+//
+// 7Dh is the manufacturer ID set aside for non-commercial use, and 50h 4Ch
+// ("PL") identifies us.  <side> is 0 for a client cable, and 1 for a host
+// device.  Each counter is a 32 bit number sent as five 7 bit bytes, least
+// significant first, in this order:
+//
+//   frames sent, bytes sent, dropped messages, packets dropped when the queue
+//   was cleared, queue high water mark, last, maximum and mean frame latency
+//   (in microseconds), and the number of frames in each latency bucket (see
+//   PACKET_QUEUE_LATENCY_BUCKETS).
+//
+// Frame latency runs from when the input a frame responds to arrived, until
+// the last packet of the frame is handed to TinyUSB.
+#define DIAGNOSTICS_CABLE 3
+
+#define DIAGNOSTICS_QUERY_STATS 0x01
+#define DIAGNOSTICS_STATS_REPLY 0x02
+
+void initialise_diagnostics(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DIAGNOSTICS_H_ */
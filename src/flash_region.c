@@ -0,0 +1,48 @@
+#include "flash_region.h"
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+_Static_assert(FLASH_REGION_SECTOR_SIZE == FLASH_SECTOR_SIZE, "FLASH_REGION_SECTOR_SIZE should match the flash");
+_Static_assert(FLASH_REGION_PAGE_SIZE == FLASH_PAGE_SIZE, "FLASH_REGION_PAGE_SIZE should match the flash");
+
+#define FLASH_REGION_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_REGION_SIZE)
+
+// How long to wait for the other core to stop running from flash.
+#define FLASH_REGION_TIMEOUT_MS 10
+
+struct program_request {
+    uint32_t offset;
+    const uint8_t *page;
+};
+
+const uint8_t *flash_region_contents(void) {
+  return (const uint8_t *) (XIP_BASE + FLASH_REGION_OFFSET);
+}
+
+// Both of these run with interrupts off and core1 paused, as nothing can run
+// from flash while it's being changed, see flash_safe_execute.
+static void erase_sector(void *param) {
+  flash_range_erase(FLASH_REGION_OFFSET + ((uintptr_t) param * FLASH_REGION_SECTOR_SIZE), FLASH_REGION_SECTOR_SIZE);
+}
+
+static void program_page(void *param) {
+  const struct program_request *request = param;
+  flash_range_program(FLASH_REGION_OFFSET + request->offset, request->page, FLASH_REGION_PAGE_SIZE);
+}
+
+bool flash_region_erase_sector(uint32_t sector) {
+  if (sector >= FLASH_REGION_SECTORS) {
+    return false;
+  }
+
+  return flash_safe_execute(erase_sector, (void *) (uintptr_t) sector, FLASH_REGION_TIMEOUT_MS) == PICO_OK;
+}
+
+bool flash_region_program_page(uint32_t offset, const uint8_t *page) {
+  if (offset % FLASH_REGION_PAGE_SIZE != 0 || offset >= FLASH_REGION_SIZE) {
+    return false;
+  }
+
+  struct program_request request = { offset, page };
+  return flash_safe_execute(program_page, &request, FLASH_REGION_TIMEOUT_MS) == PICO_OK;
+}
@@ -0,0 +1,33 @@
+#ifndef _FLASH_REGION_H_
+#define _FLASH_REGION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The sectors at the very end of flash, set aside for the persistent store.
+// Like real flash, erasing a sector sets every bit, and programming a page
+// can only clear bits.  On the Pico this is flash_region.c, in the host build
+// it's a block of RAM, see host/flash_stub.c.
+
+#define FLASH_REGION_SECTOR_SIZE 4096
+#define FLASH_REGION_PAGE_SIZE 256
+#define FLASH_REGION_SECTORS 2
+#define FLASH_REGION_SIZE (FLASH_REGION_SECTOR_SIZE * FLASH_REGION_SECTORS)
+
+// The whole region, which can be read directly.  On the Pico this is the
+// memory mapped (XIP) view of flash, so reading it costs nothing up front.
+const uint8_t *flash_region_contents(void);
+
+bool flash_region_erase_sector(uint32_t);
+
+bool flash_region_program_page(uint32_t, const uint8_t*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FLASH_REGION_H_ */
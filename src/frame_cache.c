@@ -0,0 +1,90 @@
+#include <stddef.h>
+#include <string.h>
+#include "frame_cache.h"
+
+// FNV-1a, a word at a time rather than a byte at a time, as this runs for
+// every frame.  Covers the colours and effects, but not the input time.
+uint32_t led_frame_hash(const struct led_frame *frame) {
+  const uint8_t *bytes = (const uint8_t *) frame;
+  uint32_t length = offsetof(struct led_frame, input_time);
+
+  uint32_t hash = 2166136261u;
+  uint32_t offset = 0;
+  for (; offset + sizeof(uint32_t) <= length; offset += sizeof(uint32_t)) {
+    uint32_t word;
+    memcpy(&word, bytes + offset, sizeof(word));
+    hash = (hash ^ word) * 16777619u;
+  }
+  for (; offset < length; offset++) {
+    hash = (hash ^ bytes[offset]) * 16777619u;
+  }
+
+  return hash ^ (hash >> 15);
+}
+
+void frame_cache_clear(struct frame_cache *cache) {
+  for (int index = 0; index < FRAME_CACHE_ENTRIES; index++) {
+    cache->entries[index].is_valid = false;
+  }
+}
+
+static bool keys_match(const struct frame_cache_key *a, const struct frame_cache_key *b) {
+  return a->profile == b->profile
+    && a->cable == b->cable
+    && a->is_shadow_valid == b->is_shadow_valid
+    && a->displayed_buffer == b->displayed_buffer
+    && (!a->is_shadow_valid || a->shadow_hash == b->shadow_hash)
+    && a->frame_hash == b->frame_hash;
+}
+
+// The same colours and effects, like led_frame_hash.
+static bool frames_match(const struct led_frame *a, const struct led_frame *b) {
+  return memcmp(a, b, offsetof(struct led_frame, input_time)) == 0;
+}
+
+// Look for the packets that took the device from `shadow_frame` (ignored if
+// the key says the shadow isn't valid) to `frame`.
+const struct frame_cache_entry *frame_cache_find(struct frame_cache *cache, const struct frame_cache_key *key, const struct led_frame *shadow_frame, const struct led_frame *frame) {
+  cache->clock++;
+
+  for (int index = 0; index < FRAME_CACHE_ENTRIES; index++) {
+    struct frame_cache_entry *entry = &cache->entries[index];
+    if (!entry->is_valid || !keys_match(&entry->key, key)) {
+      continue;
+    }
+
+    // The hashes only tell us it's probably the same change.
+    if (frames_match(&entry->frame, frame) && (!key->is_shadow_valid || frames_match(&entry->shadow_frame, shadow_frame))) {
+      entry->last_used = cache->clock;
+      cache->hits++;
+      return entry;
+    }
+  }
+
+  cache->misses++;
+  return NULL;
+}
+
+// Make room for a new entry, which the caller fills in.
+struct frame_cache_entry *frame_cache_add(struct frame_cache *cache, const struct frame_cache_key *key, const struct led_frame *shadow_frame, const struct led_frame *frame) {
+  struct frame_cache_entry *oldest = &cache->entries[0];
+  for (int index = 0; index < FRAME_CACHE_ENTRIES; index++) {
+    struct frame_cache_entry *entry = &cache->entries[index];
+    if (!entry->is_valid) {
+      oldest = entry;
+      break;
+    }
+
+    if ((cache->clock - entry->last_used) > (cache->clock - oldest->last_used)) {
+      oldest = entry;
+    }
+  }
+
+  oldest->is_valid = true;
+  oldest->key = *key;
+  oldest->shadow_frame = *shadow_frame;
+  oldest->frame = *frame;
+  oldest->last_used = cache->clock;
+  oldest->packet_count = 0;
+  return oldest;
+}
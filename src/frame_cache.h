@@ -0,0 +1,89 @@
+#ifndef _FRAME_CACHE_H_
+#define _FRAME_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device_profile.h"
+#include "launchpad.h"
+#include "packet_queue.h"
+
+// Remembers the USB MIDI packets we sent to take a device from one picture to
+// another, so that the next time the same device type needs the same change,
+// we can copy the packets straight into its queue instead of encoding the
+// frame again.  Moving the cross around only has a handful of likely changes
+// from any one position, so most frames are found here.
+//
+// Entries are found by a hash of their cells and effects, and each one keeps
+// a copy of both frames, which is compared in full before we use it, so two
+// frames that happen to hash the same never get each other's packets.  The
+// least recently used entry is replaced when the cache is full.  Each core has
+// its own cache, so there's no locking.
+
+#define FRAME_CACHE_ENTRIES 8
+
+// Changes that take more packets than this (such as an MK3 frame that's all
+// RGB colours) aren't cached.
+#define FRAME_CACHE_MAX_PACKETS 128
+
+struct frame_cache_key {
+    const struct device_profile *profile;
+    uint8_t cable;
+
+    // What the device was showing, see struct led_shadow.
+    bool is_shadow_valid;
+    uint8_t displayed_buffer;
+    uint32_t shadow_hash;
+
+    uint32_t frame_hash;
+};
+
+struct frame_cache_entry {
+    bool is_valid;
+    struct frame_cache_key key;
+
+    // When this was last used, in cache lookups.
+    uint32_t last_used;
+
+    // What the device was showing (if the shadow was valid), and the frame
+    // we painted over it.
+    struct led_frame shadow_frame;
+    struct led_frame frame;
+
+    // The MK1 buffer that's displayed afterwards.
+    uint8_t displayed_buffer;
+
+    uint16_t packet_count;
+    uint8_t packets[FRAME_CACHE_MAX_PACKETS * USB_MIDI_PACKET_SIZE];
+};
+
+struct frame_cache {
+    struct frame_cache_entry entries[FRAME_CACHE_ENTRIES];
+    uint32_t clock;
+
+    // Somewhere for the caller to keep what the device was showing while it
+    // paints a frame that wasn't found, to pass to frame_cache_add.  Frames
+    // are too big for core1's stack.
+    struct led_frame previous_frame;
+
+    uint32_t hits;
+    uint32_t misses;
+};
+
+uint32_t led_frame_hash(const struct led_frame*);
+
+void frame_cache_clear(struct frame_cache*);
+
+const struct frame_cache_entry *frame_cache_find(struct frame_cache*, const struct frame_cache_key*, const struct led_frame*, const struct led_frame*);
+
+struct frame_cache_entry *frame_cache_add(struct frame_cache*, const struct frame_cache_key*, const struct led_frame*, const struct led_frame*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FRAME_CACHE_H_ */
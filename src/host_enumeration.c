@@ -0,0 +1,176 @@
+#include <stdbool.h>
+#include "device_cache.h"
+#include "host_enumeration.h"
+#include "launchpad.h"
+#include "tusb.h"
+
+#define SERIAL_MAX_CHARACTERS 32
+
+#define LANGUAGE_ID_ENGLISH_US 0x0409
+
+enum HostEnumerationState {
+  HOST_ENUMERATION_IDLE,
+  HOST_ENUMERATION_DEVICE_DESCRIPTOR,
+  HOST_ENUMERATION_SERIAL_NUMBER
+};
+
+struct host_enumeration {
+    uint8_t state;
+    uint8_t daddr;
+
+    // Bumped whenever a device goes away, so that we can ignore replies to
+    // requests made for the device that used to be in this slot.
+    uint8_t generation;
+
+    // What we key the device cache with, once we've read the descriptors.
+    bool is_identified;
+    uint32_t serial_hash;
+};
+
+static struct host_enumeration enumerations[MAX_HOST_LAUNCHPADS];
+
+// The descriptors are written by the host controller, so they may need to
+// live in a particular section.  One set per interface, so that enumerations
+// don't get in each other's way.
+CFG_TUH_MEM_SECTION static struct {
+  TUH_EPBUF_TYPE_DEF(tusb_desc_device_t, device);
+  TUH_EPBUF_DEF(serial, (SERIAL_MAX_CHARACTERS + 1) * sizeof(uint16_t));
+} descriptors[MAX_HOST_LAUNCHPADS];
+
+static host_enumeration_callback on_enumerated = NULL;
+
+void host_enumeration_init(host_enumeration_callback callback) {
+  on_enumerated = callback;
+}
+
+static uintptr_t make_user_data(uint8_t client_idx) {
+  return client_idx | (enumerations[client_idx].generation << 8);
+}
+
+// Returns the interface a reply is for, or -1 if it's out of date.
+static int check_user_data(uintptr_t user_data, uint8_t expected_state) {
+  uint8_t client_idx = user_data & 0xFF;
+  if (client_idx >= MAX_HOST_LAUNCHPADS) {
+    return -1;
+  }
+
+  const struct host_enumeration *enumeration = &enumerations[client_idx];
+  if (enumeration->state != expected_state || enumeration->generation != ((user_data >> 8) & 0xFF)) {
+    return -1;
+  }
+
+  return client_idx;
+}
+
+static void finish_enumeration(uint8_t client_idx, enum LaunchpadModel model) {
+  enumerations[client_idx].state = HOST_ENUMERATION_IDLE;
+
+  if (on_enumerated != NULL) {
+    on_enumerated(client_idx, model);
+  }
+}
+
+// Models we know from their USB IDs don't need the cache.  For the rest, the
+// cache holds what a device inquiry told us last time, which saves asking
+// again.  `is_identified` is false if we couldn't read the serial number, in
+// which case we don't know which device this is, so nothing is cached for it.
+static void identify_device(uint8_t client_idx, uint32_t serial_hash, bool is_identified) {
+  const tusb_desc_device_t *device = &descriptors[client_idx].device;
+  enumerations[client_idx].is_identified = is_identified;
+  enumerations[client_idx].serial_hash = serial_hash;
+
+  enum LaunchpadModel model = find_device_model(device->idVendor, device->idProduct);
+  if (model == LAUNCHPAD_MODEL_UNKNOWN && is_identified) {
+    device_cache_lookup(device->idVendor, device->idProduct, serial_hash, &model);
+  }
+
+  finish_enumeration(client_idx, model);
+}
+
+static void serial_number_received(tuh_xfer_t *xfer) {
+  int client_idx = check_user_data(xfer->user_data, HOST_ENUMERATION_SERIAL_NUMBER);
+  if (client_idx < 0) {
+    return;
+  }
+
+  uint32_t serial_hash = 0;
+  bool is_identified = xfer->result == XFER_RESULT_SUCCESS;
+  if (is_identified) {
+    const uint16_t *serial = (const uint16_t *) descriptors[client_idx].serial;
+
+    // The first word holds the descriptor's length in bytes and its type.
+    uint16_t length = ((serial[0] & 0xFF) - 2) / 2;
+    if (length > SERIAL_MAX_CHARACTERS) {
+      length = SERIAL_MAX_CHARACTERS;
+    }
+
+    serial_hash = device_cache_hash_serial(serial + 1, length);
+  }
+
+  identify_device(client_idx, serial_hash, is_identified);
+}
+
+static void device_descriptor_received(tuh_xfer_t *xfer) {
+  int client_idx = check_user_data(xfer->user_data, HOST_ENUMERATION_DEVICE_DESCRIPTOR);
+  if (client_idx < 0) {
+    return;
+  }
+
+  if (xfer->result != XFER_RESULT_SUCCESS) {
+    finish_enumeration(client_idx, LAUNCHPAD_MODEL_UNKNOWN);
+    return;
+  }
+
+  struct host_enumeration *enumeration = &enumerations[client_idx];
+  if (descriptors[client_idx].device.iSerialNumber != 0) {
+    enumeration->state = HOST_ENUMERATION_SERIAL_NUMBER;
+    if (tuh_descriptor_get_serial_string(enumeration->daddr, LANGUAGE_ID_ENGLISH_US, descriptors[client_idx].serial, sizeof(descriptors[client_idx].serial), serial_number_received, make_user_data(client_idx))) {
+      return;
+    }
+  }
+
+  // Without a serial number, we can still go by the vendor and product.
+  identify_device(client_idx, 0, descriptors[client_idx].device.iSerialNumber == 0);
+}
+
+// Start working out what the device behind a newly mounted MIDI interface is.
+// Returns straight away, the callback passed to host_enumeration_init is
+// called once we know.
+void host_enumeration_start(uint8_t client_idx, uint8_t daddr) {
+  if (client_idx >= MAX_HOST_LAUNCHPADS) {
+    return;
+  }
+
+  struct host_enumeration *enumeration = &enumerations[client_idx];
+  enumeration->generation++;
+  enumeration->daddr = daddr;
+  enumeration->is_identified = false;
+  enumeration->state = HOST_ENUMERATION_DEVICE_DESCRIPTOR;
+
+  if (!tuh_descriptor_get_device(daddr, &descriptors[client_idx].device, sizeof(tusb_desc_device_t), device_descriptor_received, make_user_data(client_idx))) {
+    finish_enumeration(client_idx, LAUNCHPAD_MODEL_UNKNOWN);
+  }
+}
+
+// Forget about a device that's gone away part way through.
+void host_enumeration_cancel(uint8_t client_idx) {
+  if (client_idx >= MAX_HOST_LAUNCHPADS) {
+    return;
+  }
+
+  enumerations[client_idx].generation++;
+  enumerations[client_idx].state = HOST_ENUMERATION_IDLE;
+  enumerations[client_idx].is_identified = false;
+}
+
+// Once a device inquiry has told us what a device is, remember that for the
+// next time it's plugged in, so that we don't have to ask again.  Failed or
+// unanswered inquiries aren't remembered, so the device is asked again.
+void host_enumeration_remember_model(uint8_t client_idx, enum LaunchpadModel model) {
+  if (client_idx >= MAX_HOST_LAUNCHPADS || !enumerations[client_idx].is_identified || model == LAUNCHPAD_MODEL_UNKNOWN) {
+    return;
+  }
+
+  const tusb_desc_device_t *device = &descriptors[client_idx].device;
+  device_cache_store(device->idVendor, device->idProduct, enumerations[client_idx].serial_hash, model);
+}
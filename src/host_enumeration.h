@@ -0,0 +1,36 @@
+#ifndef _HOST_ENUMERATION_H_
+#define _HOST_ENUMERATION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "device_profile.h"
+
+// Works out which model each device on the host port is, without blocking the
+// host stack.  We ask for the device descriptor, then the serial number, and
+// TinyUSB calls us back as each one arrives, so tuh_task keeps servicing the
+// devices that are already running in the meantime.  Every MIDI interface has
+// its own buffers, so several devices can be enumerated at once.
+//
+// All of this runs on core1.
+
+// Called once we know what the device is, LAUNCHPAD_MODEL_UNKNOWN if it isn't
+// one we support, or if we couldn't read its descriptors.
+typedef void (*host_enumeration_callback)(uint8_t client_idx, enum LaunchpadModel model);
+
+void host_enumeration_init(host_enumeration_callback);
+
+void host_enumeration_start(uint8_t, uint8_t);
+
+void host_enumeration_cancel(uint8_t);
+
+void host_enumeration_remember_model(uint8_t, enum LaunchpadModel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_ENUMERATION_H_ */
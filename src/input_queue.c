@@ -0,0 +1,56 @@
+#include "input_queue.h"
+
+void input_queue_init(struct input_queue *queue) {
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->overflow_count, 0);
+  queue->high_water_mark = 0;
+}
+
+// How many events can be pushed before the queue is full.  Only call this from
+// the producer, for whom the answer can only go up.
+uint32_t input_queue_free(struct input_queue *queue) {
+  unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  return INPUT_QUEUE_LENGTH - (tail - head);
+}
+
+// Only call this from the producer (core1 for host input).
+bool input_queue_push(struct input_queue *queue, const struct input_event *event) {
+  unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+  unsigned int waiting = tail - head;
+  if (waiting >= INPUT_QUEUE_LENGTH) {
+    atomic_store_explicit(&queue->overflow_count, atomic_load_explicit(&queue->overflow_count, memory_order_relaxed) + 1, memory_order_relaxed);
+    return false;
+  }
+
+  queue->events[tail & (INPUT_QUEUE_LENGTH - 1)] = *event;
+
+  // Publish the event only once it's been written in full.
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+  if (waiting + 1 > queue->high_water_mark) {
+    queue->high_water_mark = waiting + 1;
+  }
+
+  return true;
+}
+
+// Only call this from the consumer (core0 for host input).
+bool input_queue_pop(struct input_queue *queue, struct input_event *event) {
+  unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+  if (head == tail) {
+    return false;
+  }
+
+  *event = queue->events[head & (INPUT_QUEUE_LENGTH - 1)];
+
+  // Hand the slot back to the producer only once we've copied the event out.
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+  return true;
+}
@@ -0,0 +1,69 @@
+#ifndef _INPUT_QUEUE_H_
+#define _INPUT_QUEUE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The host stack runs on core1, but only core0 is allowed to change the board
+// state.  Core1 passes everything it hears about through a single producer,
+// single consumer ring buffer, which needs no locks as each index only ever
+// has one writer.  Packets that core0 routes to host devices go the other way
+// through a second queue.
+
+enum InputEventType {
+  INPUT_EVENT_HOST_PACKET,
+  INPUT_EVENT_HOST_MOUNTED,
+  INPUT_EVENT_HOST_UNMOUNTED,
+  // Sent from core0 to core1 when a device inquiry tells us what a host device
+  // is, with the model in the first byte.
+  INPUT_EVENT_HOST_IDENTIFIED
+};
+
+struct input_event {
+    // When the event was received, in microseconds since boot.
+    uint32_t timestamp;
+    uint8_t type;
+    uint8_t client_idx;
+
+    // The USB MIDI packet for incoming packets, or the Launchpad version (in the
+    // first byte) for newly mounted devices.
+    uint8_t data[4];
+};
+
+// Must be a power of two.
+#define INPUT_QUEUE_LENGTH 64
+
+struct input_queue {
+    struct input_event events[INPUT_QUEUE_LENGTH];
+
+    // The next event to read, only written by the consumer.
+    atomic_uint head;
+
+    // The next free slot, only written by the producer.
+    atomic_uint tail;
+
+    // How many events the producer had to throw away because the queue was full.
+    atomic_uint overflow_count;
+
+    // The most events that have been waiting at once.
+    uint32_t high_water_mark;
+};
+
+void input_queue_init(struct input_queue*);
+
+uint32_t input_queue_free(struct input_queue*);
+
+bool input_queue_push(struct input_queue*, const struct input_event*);
+
+bool input_queue_pop(struct input_queue*, struct input_event*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _INPUT_QUEUE_H_ */
@@ -1,67 +1,460 @@
+#include <stdatomic.h>
 #include <stdint.h>
+#include <string.h>
+#include "animation.h"
+#include "compositor.h"
+#include "device_profile.h"
+#include "frame_cache.h"
 #include "launchpad.h"
+#include "packet_queue.h"
+#include "pad_layout.h"
+#include "palette.h"
+#include "sysex_assembler.h"
+#include "pico/time.h"
 #include "tusb.h"
 
-void initialise_client_launchpads(void) {
-  initialise_mk1_client_launchpads();
-  initialise_mk2_client_launchpads();
-  initialise_mk3_client_launchpads();
+// Where a stream of bytes should end up, either one of our own virtual cables
+// on the client side, or a cable on a device connected to the host port.
+struct launchpad_output {
+  bool is_host;
+  uint8_t client_idx;
+  uint8_t cable;
+  const struct device_profile *profile;
+};
+
+// The model each of our virtual cables talks to, until a device inquiry tells
+// us what's really on the other end, see set_client_model.  The last cable
+// isn't a Launchpad, it's used for diagnostics, see diagnostics.c.
+static enum LaunchpadModel client_models[CFG_TUD_MIDI_NUMCABLES_OUT] = {
+  LAUNCHPAD_MODEL_S,
+  LAUNCHPAD_MODEL_PRO_MK2,
+  LAUNCHPAD_MODEL_PRO_MK3,
+  LAUNCHPAD_MODEL_UNKNOWN
+};
+
+// What each device looked like after we last painted it.  The client side has
+// one device per virtual cable, the host side has one per MIDI interface.
+static struct led_shadow client_shadows[CFG_TUD_MIDI_NUMCABLES_OUT];
+static struct led_shadow host_shadows[MAX_HOST_LAUNCHPADS];
+
+// Everything we've painted on each client cable or host device that TinyUSB
+// hasn't accepted yet.
+static struct packet_queue client_queues[CFG_TUD_MIDI_NUMCABLES_OUT];
+static struct packet_queue host_queues[MAX_HOST_LAUNCHPADS];
+
+// The packets it took to get from one frame to another on each type of device,
+// see frame_cache.h.  The host cache belongs to core1.
+static struct frame_cache client_frame_cache;
+static struct frame_cache host_frame_cache;
+
+// All of the client cables share a single FIFO, so if we run out of room part
+// way through a sysex message, we finish that message before moving on to
+// another cable.  This is the cable we need to finish, if any.
+static int client_sysex_cable = -1;
+
+// The client cable that goes first the next time we service the queues, so
+// that no cable is always at the back of the line.
+static uint8_t next_client_cable = 0;
+
+// The profile of each initialised host device, or NULL.  Like the rest of the
+// host output state, this belongs to core1, see paint_host_launchpads.
+static const struct device_profile *host_profiles[MAX_HOST_LAUNCHPADS];
+
+// Whether there's a device on each host interface at all, even one we don't
+// recognise yet.  Also belongs to core1.
+static bool is_host_attached[MAX_HOST_LAUNCHPADS];
+
+_Static_assert(MAX_HOST_LAUNCHPADS == CFG_TUH_MIDI, "MAX_HOST_LAUNCHPADS should match CFG_TUH_MIDI");
+
+// If a device has fallen so far behind that a message doesn't fit in its
+// queue, we drop the message and paint the whole device again next time,
+// rather than leave it with the wrong picture.
+static void write_to_output(const struct launchpad_output *output, const uint8_t *bytes, uint32_t length) {
+  if (output->is_host) {
+    if (!packet_queue_push_message(&host_queues[output->client_idx], output->cable, bytes, length)) {
+      host_shadows[output->client_idx].is_valid = false;
+    }
+  }
+  else {
+    if (!packet_queue_push_message(&client_queues[output->cable], output->cable, bytes, length)) {
+      client_shadows[output->cable].is_valid = false;
+    }
+  }
 }
 
-void initialise_mk1_client_launchpads(void) {
-  // Change the button layout Change the button layout Change the button layout
-  // Host » Launchpad: Channel 1: controller 0 set to 1 or 2.
-  //  B0h, 00h, 01-02h (176, 0, 1-2). 
-  uint8_t x_y_mode_packet[3] = {
-    0xB0, 0x00, 1
-  };
+void invalidate_client_shadows(void) {
+  for (int cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    client_shadows[cable].is_valid = false;
+    client_shadows[cable].displayed_buffer = 0;
+  }
+}
 
-  // This should use cable 0.
-  tud_midi_stream_write(0, x_y_mode_packet, sizeof(x_y_mode_packet));
+void invalidate_host_shadow(uint8_t client_idx) {
+  if (client_idx < MAX_HOST_LAUNCHPADS) {
+    host_shadows[client_idx].is_valid = false;
+    host_shadows[client_idx].displayed_buffer = 0;
+  }
 }
 
-void initialise_mk2_client_launchpads(void) {
-  // TODO: Rework when we can send sysex on the host side again.
-  // if (!tuh_mounted(board_state->host_port_client_idx)) { return; }
-  // if (!board_state->host_port_client_idx) { return; }
-  
-  // Select "standalone" mode (it's the default, but for users who also use
-  // Ableton, this will ensure things are set up properly).
-  uint8_t standalone_mode_packet[9] = {
-    0xf0, 0x00, 0x20, 0x29, 0x02, 0x10, 0x2C, 0x03, 0xf7
+// The MK1 has two buffers, one that's displayed, and one that's updated.
+// Host » Launchpad: B0h, 00h, 20-3Dh, where the data is
+// 32 + (16 x Copy) + (8 x Flash) + (4 x Update) + Display.  When "copy" is set,
+// the newly displayed buffer is copied to the newly updated buffer.
+static void write_mk1_buffer_control(const struct launchpad_output *output, int displayed_buffer, int updated_buffer, bool is_copy) {
+  uint8_t buffer_control_message[3] = {
+    0xB0, 0x00, 32 + (is_copy ? 16 : 0) + (updated_buffer * 4) + displayed_buffer
   };
 
-  // Select "programmer" layout ("note" layout is the default)
-  uint8_t programmer_layout_packet[9] = {
-    0xf0, 0, 0x20, 0x29, 0x02, 0x10, 0x16, 0x3, 0xf7
-  };
+  write_to_output(output, buffer_control_message, sizeof(buffer_control_message));
+}
 
-  // This should use cable 1.
-  tud_midi_stream_write(1, standalone_mode_packet, sizeof(standalone_mode_packet));
-  tud_midi_stream_write(1, programmer_layout_packet, sizeof programmer_layout_packet);
+static struct launchpad_output client_output(uint8_t cable) {
+  struct launchpad_output output = { false, 0, cable, get_device_profile(client_models[cable]) };
+  return output;
 }
 
-void initialise_mk3_client_launchpads(void) {
-  // Select the programmer's layout, we want layout 11h and page 0
-  // F0h 00h 20h 29h 02h 0Eh 00h <layout> <page> 00h F7h
-  uint8_t select_programmers_layout[] = {
-    0xF0, 0x00, 0x20, 0x29, 0x02, 0x0E, 0x00, 0x11, 0x00, 0x00, 0xF7
-  };
+static void initialise_output(const struct launchpad_output *output) {
+  if (output->profile->init_sequence_length > 0) {
+    write_to_output(output, output->profile->init_sequence, output->profile->init_sequence_length);
+  }
+}
+
+void initialise_client_launchpads(void) {
+  // Whatever we painted before the computer connected to us is gone.
+  for (int cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    packet_queue_clear(&client_queues[cable]);
+  }
+  client_sysex_cable = -1;
+
+  invalidate_client_shadows();
+
+  for (uint8_t cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    struct launchpad_output output = client_output(cable);
+    initialise_output(&output);
+  }
+}
+
+enum LaunchpadModel get_client_model(uint8_t cable) {
+  return cable < CFG_TUD_MIDI_NUMCABLES_OUT ? client_models[cable] : LAUNCHPAD_MODEL_UNKNOWN;
+}
+
+// Change what we think is on the other end of a client cable.  The device
+// needs initialising and painting from scratch in its own encoding, so we
+// throw away anything we'd queued for the old model.
+void set_client_model(uint8_t cable, enum LaunchpadModel model) {
+  if (cable >= CFG_TUD_MIDI_NUMCABLES_OUT || client_models[cable] == model) {
+    return;
+  }
+
+  client_models[cable] = model;
+
+  packet_queue_clear(&client_queues[cable]);
+  if (client_sysex_cable == cable) {
+    client_sysex_cable = -1;
+  }
+
+  client_shadows[cable].is_valid = false;
+  client_shadows[cable].displayed_buffer = 0;
+
+  struct launchpad_output output = client_output(cable);
+  initialise_output(&output);
+}
+
+// Everything we show on the grid, see compositor.h.  Only core0 uses this.
+static struct compositor board_compositor;
+
+// Where the cross was last drawn on the cursor layer, if anywhere.
+static int cursor_row = -1;
+static int cursor_column = -1;
+
+// Pads that animate on top of the layers.  Only core0 uses this.
+static struct animator board_animator;
+
+struct compositor *get_board_compositor(void) {
+  return &board_compositor;
+}
+
+struct animator *get_board_animator(void) {
+  return &board_animator;
+}
+
+static void draw_cursor(int row, int column, struct led_colour colour, uint8_t alpha) {
+  for (int offset = 0; offset < LAUNCHPAD_GRID_SIZE; offset++) {
+    compositor_set_cell(&board_compositor, COMPOSITOR_LAYER_CURSOR, led_index(row, offset), colour, alpha);
+    compositor_set_cell(&board_compositor, COMPOSITOR_LAYER_CURSOR, led_index(offset, column), colour, alpha);
+  }
+}
+
+// Paint a "cross" that runs through the active row and column, on top of
+// whatever else is in the background, with any overlays and animated pads on
+// top.  We only move the cross when the cursor moves, so only the cells it
+// leaves and enters have to be worked out again.
+void render_board_frame(struct board_state *board_state, struct led_frame *frame) {
+  if (board_state->active_row != cursor_row || board_state->active_column != cursor_column) {
+    if (cursor_row >= 0) {
+      draw_cursor(cursor_row, cursor_column, LED_COLOUR_BLACK, COMPOSITOR_TRANSPARENT);
+    }
+
+    cursor_row = board_state->active_row;
+    cursor_column = board_state->active_column;
+    draw_cursor(cursor_row, cursor_column, LED_COLOUR_WHITE, COMPOSITOR_OPAQUE);
+  }
+
+  compositor_compose(&board_compositor, frame);
+
+  uint32_t now = time_us_32();
+  animator_apply(&board_animator, frame, now);
+
+  frame->input_time = board_state->has_pending_input ? board_state->pending_input_time : now;
+}
+
+// The fewest packets we send from one client cable before moving on to the
+// next, i.e. one full speed bulk packet.  We always finish the message we're
+// in the middle of, so a turn may run on to the end of a long sysex message.
+#define CLIENT_PACKETS_PER_TURN 16
+
+// Give a client cable its turn.  Returns false once TinyUSB's FIFO is full.
+static bool send_client_turn(uint8_t cable, bool *is_sent) {
+  struct packet_queue *queue = &client_queues[cable];
+  uint8_t packet[USB_MIDI_PACKET_SIZE];
+  uint16_t sent_packets = 0;
+
+  while (packet_queue_peek(queue, packet, 1)) {
+    if (sent_packets >= CLIENT_PACKETS_PER_TURN && client_sysex_cable < 0) {
+      break;
+    }
+
+    if (!tud_midi_packet_write(packet)) {
+      return false;
+    }
+
+    packet_queue_pop(queue, 1);
+    sent_packets++;
+    *is_sent = true;
+    client_sysex_cable = (packet[0] & 0x0F) == USB_MIDI_CIN_SYSEX_START ? cable : -1;
+  }
+
+  packet_queue_check_frame_sent(queue, time_us_32());
+  return true;
+}
+
+// Called every time round the main loop, to pick up where we left off when
+// TinyUSB last ran out of room.  The cables take turns, a slice at a time, so
+// every device sees a new frame after a similar delay, however much the other
+// devices need.
+void service_client_launchpads(void) {
+  bool is_sent = false;
+
+  // Finish any sysex message that was cut off, before anything else.
+  if (client_sysex_cable >= 0 && !send_client_turn(client_sysex_cable, &is_sent)) {
+    return;
+  }
+
+  bool is_progressing = true;
+  while (is_progressing) {
+    is_progressing = false;
+
+    for (int turn = 0; turn < CFG_TUD_MIDI_NUMCABLES_OUT; turn++) {
+      uint8_t cable = next_client_cable;
+      next_client_cable = (next_client_cable + 1) % CFG_TUD_MIDI_NUMCABLES_OUT;
+
+      bool is_cable_sent = false;
+      if (!send_client_turn(cable, &is_cable_sent)) {
+        return;
+      }
+
+      is_progressing = is_progressing || is_cable_sent;
+    }
+  }
+}
+
+// The client side is busy until everything from the last frame has been sent.
+bool is_client_output_busy(void) {
+  for (int cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    if (client_queues[cable].count > 0) {
+      return true;
+    }
+  }
 
-  // They don't have a "clear all" method, just a sysex to send a value for
-  // every pad, so we skip that.
+  return false;
+}
 
-  // This should use cable 2.
-  tud_midi_stream_write(2, select_programmers_layout, sizeof select_programmers_layout);
+// Queue a message that isn't part of a frame, e.g. a reply on the diagnostics
+// cable.  Returns false if there isn't room for it.
+bool write_client_message(uint8_t cable, const uint8_t *bytes, uint32_t length) {
+  return cable < CFG_TUD_MIDI_NUMCABLES_OUT && packet_queue_push_message(&client_queues[cable], cable, bytes, length);
 }
 
-void paint_client_launchpads(struct board_state *board_state) {
-  paint_mk1_client_launchpads(board_state);
-  paint_mk2_client_launchpads(board_state);
-  paint_mk3_client_launchpads(board_state);
+// The host queues belong to core1, which publishes a copy of each queue's
+// counters whenever they change, for core0 to read.  The version is odd while
+// a copy is being written, as in device_cache.c.
+static struct packet_queue_stats host_stats[MAX_HOST_LAUNCHPADS];
+static atomic_uint host_stats_versions[MAX_HOST_LAUNCHPADS];
+
+static void publish_host_stats(uint8_t client_idx) {
+  atomic_fetch_add_explicit(&host_stats_versions[client_idx], 1, memory_order_acq_rel);
+  host_stats[client_idx] = packet_queue_get_stats(&host_queues[client_idx]);
+  atomic_fetch_add_explicit(&host_stats_versions[client_idx], 1, memory_order_release);
 }
 
-void paint_mk1_client_launchpads(struct board_state *board_state) {
+// Queue a packet we're forwarding to one of our client cables, after changing
+// its cable number to match.
+bool write_client_packet(uint8_t cable, const uint8_t *packet) {
+  if (cable >= CFG_TUD_MIDI_NUMCABLES_OUT) {
+    return false;
+  }
+
+  uint8_t forwarded_packet[USB_MIDI_PACKET_SIZE] = { (cable << 4) | (packet[0] & 0x0F), packet[1], packet[2], packet[3] };
+  return packet_queue_push_packet(&client_queues[cable], forwarded_packet);
+}
+
+// Sysex that core0 forwards to a host device arrives a packet at a time, and
+// is held here until the whole message has arrived, so that it can't end up in
+// the middle of a frame.
+static uint8_t host_sysex_packets[MAX_HOST_LAUNCHPADS][SYSEX_MAX_PACKETS][USB_MIDI_PACKET_SIZE];
+static uint8_t host_sysex_packet_counts[MAX_HOST_LAUNCHPADS];
+
+// The same for a host device, which gets the packet on the cable its profile
+// tells us to use.  Like the rest of the host output, this must only be called
+// on core1.
+bool write_host_packet(uint8_t client_idx, const uint8_t *packet) {
+  if (client_idx >= MAX_HOST_LAUNCHPADS || host_profiles[client_idx] == NULL) {
+    return false;
+  }
+
+  uint8_t cable = host_profiles[client_idx]->host_cable;
+  uint8_t forwarded_packet[USB_MIDI_PACKET_SIZE] = { (cable << 4) | (packet[0] & 0x0F), packet[1], packet[2], packet[3] };
+
+  bool is_queued = true;
+  if (is_sysex_packet(packet)) {
+    uint8_t *count = &host_sysex_packet_counts[client_idx];
+    if (packet[1] == 0xF0) {
+      *count = 0;
+    }
+    else if (*count == 0) {
+      // The rest of a message whose start we never saw.
+      return false;
+    }
+
+    if (*count >= SYSEX_MAX_PACKETS) {
+      return false;
+    }
+
+    memcpy(host_sysex_packets[client_idx][(*count)++], forwarded_packet, USB_MIDI_PACKET_SIZE);
+
+    // Wait for the packet that ends the message.
+    if ((packet[0] & 0x0F) == USB_MIDI_CIN_SYSEX_START) {
+      return true;
+    }
+
+    is_queued = packet_queue_push_packets(&host_queues[client_idx], host_sysex_packets[client_idx][0], *count);
+    *count = 0;
+  }
+  else {
+    is_queued = packet_queue_push_packet(&host_queues[client_idx], forwarded_packet);
+  }
+
+  publish_host_stats(client_idx);
+  return is_queued;
+}
+
+// Queue a message for a host device that isn't part of a frame, e.g. a device
+// inquiry.  Unlike the rest of the host output, this works for devices we
+// don't recognise yet.  Core1 only.
+bool write_host_message(uint8_t client_idx, uint8_t cable, const uint8_t *bytes, uint32_t length) {
+  if (client_idx >= MAX_HOST_LAUNCHPADS || !is_host_attached[client_idx]) {
+    return false;
+  }
+
+  bool is_queued = packet_queue_push_message(&host_queues[client_idx], cable, bytes, length);
+  publish_host_stats(client_idx);
+  return is_queued;
+}
+
+struct packet_queue_stats get_client_queue_stats(uint8_t cable) {
+  if (cable >= CFG_TUD_MIDI_NUMCABLES_OUT) {
+    struct packet_queue_stats empty_stats = { 0 };
+    return empty_stats;
+  }
+  return packet_queue_get_stats(&client_queues[cable]);
+}
+
+// Safe to call from either core.
+struct packet_queue_stats get_host_queue_stats(uint8_t client_idx) {
+  struct packet_queue_stats stats = { 0 };
+  if (client_idx >= MAX_HOST_LAUNCHPADS) {
+    return stats;
+  }
+
+  unsigned int before;
+  unsigned int after;
+  do {
+    before = atomic_load_explicit(&host_stats_versions[client_idx], memory_order_acquire);
+    stats = host_stats[client_idx];
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&host_stats_versions[client_idx], memory_order_relaxed);
+  } while ((before & 1) != 0 || before != after);
+
+  return stats;
+}
+
+// The effect a device should run on a pad by itself, or zero if the pad isn't
+// animated, or the device can't animate it, in which case it shows the colour
+// in the frame's cells instead.
+static inline uint8_t device_effect(const struct device_profile *profile, const struct led_frame *frame, int index) {
+  return frame->effects[index] & profile->effects;
+}
+
+// Whether a pad looks any different on a particular device.  A pad a device
+// animates by itself only changes if the effect or its colour does.
+static inline bool is_cell_changed(const struct device_profile *profile, const struct led_shadow *shadow, const struct led_frame *frame, int index) {
+  if (!shadow->is_valid) {
+    return true;
+  }
+
+  if ((shadow->frame.effects[index] | frame->effects[index]) == 0) {
+    return !led_colour_equals(shadow->frame.cells[index], frame->cells[index]);
+  }
+
+  uint8_t effect = device_effect(profile, frame, index);
+  if (effect != device_effect(profile, &shadow->frame, index)) {
+    return true;
+  }
+
+  return effect ? shadow->frame.effect_colours[index] != frame->effect_colours[index] : !led_colour_equals(shadow->frame.cells[index], frame->cells[index]);
+}
+
+// The MK1 has an 8 x 8 grid of pads, a column of round "scene" buttons on the
+// right, and a row of round "automap" buttons along the top.  We shift
+// everything over by one column and up by one row so that the square pads
+// line up with the other generations, which makes the scene buttons column 9
+// and the automap buttons row 9.  There is nothing in row 0 or column 0.  See
+// pad_layout.c for the full mapping.
+#define MK1_PAD_COUNT 80
+
+// The MK1 only has red and green LEDs with four brightness levels each, and
+// encodes the colour in the velocity: Velocity = (16 x Green) + Red + Flags.
+// Blue is ignored, see mk1_colour_for_cell.  With no flags set, only the
+// buffer being updated changes, with both the "copy" and "clear" flags (0x0C)
+// set, both buffers change.
+#if MK1_DOUBLE_BUFFERED
+#define MK1_VELOCITY_FLAGS 0x00
+#else
+#define MK1_VELOCITY_FLAGS 0x0C
+#endif
+
+static inline uint8_t mk1_velocity(const struct led_frame *frame, int index) {
+  return mk1_colour_for_cell(frame->cells[index], index) | MK1_VELOCITY_FLAGS;
+}
+
+// Update a single pad, which is a note for the grid and the scene buttons, and
+// a controller for the automap buttons along the top.
+static void write_pad(const struct launchpad_output *output, const struct pad_address *pad, uint8_t velocity) {
+  uint8_t pad_message[3] = { pad->status, pad->number, velocity };
+  write_to_output(output, pad_message, sizeof(pad_message));
+}
+
+static void write_mk1_rapid_update(const struct launchpad_output *output, const struct led_frame *frame) {
   // There is a wacky mode for note on messages on channel 3 where the note is
   // one colour for one pad and the velocity is the colour for the next pad. You
   // blaze through them in sequnce from the top-left corner, which is not how
@@ -72,424 +465,685 @@ void paint_mk1_client_launchpads(struct board_state *board_state) {
     MIDI_CIN_NOTE_ON << 4, 127, 0
   };
 
-  tud_midi_stream_write(0, initial_note_on_message, sizeof(initial_note_on_message));
+  write_to_output(output, initial_note_on_message, sizeof(initial_note_on_message));
 
-  for (int row = 8; row > 0; row--) {
-    // Shift by one column so that the square pads align on all units.
-    for (int col = 1; col < 9; col+=2) {
-      uint8_t note = ((row == board_state->active_row) || (col == board_state->active_column)) ? 0x3C : 0x0C;
-      uint8_t velocity = ((row == board_state->active_row) || ((col+1) == board_state->active_column)) ? 0x3C : 0x0C;
+  for (int cell = 0; cell < MK1_RAPID_UPDATE_CELLS; cell += 2) {
+    uint8_t note = mk1_velocity(frame, mk1_rapid_update_cells[cell]);
+    uint8_t velocity = mk1_velocity(frame, mk1_rapid_update_cells[cell + 1]);
 
-      uint8_t note_on_message[3] = { 0x92, note, velocity };
+    uint8_t note_on_message[3] = { 0x92, note, velocity };
+    write_to_output(output, note_on_message, sizeof(note_on_message));
+  }
+}
 
-      // The virtual port for the MK1 should be cable 0.
-      tud_midi_stream_write(0, note_on_message, sizeof(note_on_message));
+static void paint_mk1(const struct launchpad_output *output, struct led_shadow *shadow, const struct led_frame *frame) {
+  const struct pad_address *pads = get_pad_layout(output->profile->note_layout)->pad_for_cell;
+
+  int changed_pads = 0;
+  if (shadow->is_valid) {
+    for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+      if (pads[index].status && !led_colour_equals(shadow->frame.cells[index], frame->cells[index])) {
+        changed_pads++;
+      }
     }
   }
 
-  // Right-most column, equivalent to column 9 on other devices.  Inverted relative to the pads.
-  for (int row = 8; row > 0; row-=2) {
-    uint8_t note = ((board_state->active_column == 9) || (row == board_state->active_row)) ? 0x3C : 0x0C;
-    uint8_t velocity = ((board_state->active_column == 9) || ((row-1) == board_state->active_row)) ? 0x3C : 0x0C;
-    uint8_t note_on_message[3] = { 0x92, note, velocity };
+  // The rapid update mode sets two pads per message, so once half of the pads
+  // have changed, it's cheaper to repaint everything.
+  bool is_rapid_update = (output->profile->encodings & LAUNCHPAD_ENCODING_RAPID_UPDATE) != 0;
+  if (is_rapid_update && (!shadow->is_valid || changed_pads >= (MK1_PAD_COUNT / 2))) {
+    write_mk1_rapid_update(output, frame);
+  }
+  else if (!shadow->is_valid || changed_pads > 0) {
+    for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+      if (pads[index].status && (!shadow->is_valid || !led_colour_equals(shadow->frame.cells[index], frame->cells[index]))) {
+        write_pad(output, &pads[index], mk1_velocity(frame, index));
+      }
+    }
+  }
 
-    // The virtual port for the MK1 should be cable 0.
-    tud_midi_stream_write(0, note_on_message, sizeof(note_on_message));
+#if MK1_DOUBLE_BUFFERED
+  // Once the frame is complete, show the buffer we've been drawing in, and copy
+  // it to the other buffer, so that the next frame only needs what's changed.
+  // If nothing changed, there's nothing to show, and we can skip the flip.
+  if (!shadow->is_valid || changed_pads > 0) {
+    int updated_buffer = 1 - shadow->displayed_buffer;
+    write_mk1_buffer_control(output, updated_buffer, shadow->displayed_buffer, true);
+    shadow->displayed_buffer = updated_buffer;
   }
+#endif
 
-  // Top-most row, equivalent to row 9 on larger devices.
-  for (int col = 1; col < 9; col+=2) {
-    uint8_t note = ((board_state->active_row == 9) || (col == board_state->active_column)) ? 0x3C : 0x0C;
-    uint8_t velocity = ((board_state->active_row == 9) || ((col+1) == board_state->active_column)) ? 0x3C : 0x0C;
-    uint8_t note_on_message[3] = { 0x92, note, velocity };
+  shadow->frame = *frame;
+  shadow->is_valid = true;
+}
 
-    // The virtual port for the MK1 should be cable 0.
-    tud_midi_stream_write(0, note_on_message, sizeof(note_on_message));
-  }
+// The MK2 takes RGB values from 0-63, where we use 0-127.
+static void append_mk2_rgb(uint8_t *buffer, size_t *length, struct led_colour colour) {
+  buffer[(*length)++] = colour.red >> 1;
+  buffer[(*length)++] = colour.green >> 1;
+  buffer[(*length)++] = colour.blue >> 1;
 }
 
-void paint_mk2_client_launchpads(struct board_state *board_state) {
-  // Sysex messages used to paint the Launchpad in this pass....
+// The side light, which uses the same numbering as the pads.
+#define MK2_SIDE_LIGHT 99
 
-  // The "paint all" operation doesn't support RGB, so you have to pick a colour
-  // from the built-in 128 colour palette, for example, 0 for black and 3 for
-  // white, 24 for green.
-  //
+// Client cables are painted on core0 and host devices on core1, at the same
+// time, so anything the paint functions build up outside the stack needs one
+// copy for each, picked with this.
+#define PAINT_CORES 2
 
-  // Paint All F0h 00h 20h 29h 02h 10h 0Eh                                                                                                                                  <Colour> F7h
-  uint8_t paint_all_sysex[9] = {
-      0xf0, 0, 0x20, 0x29, 0x2, 0x10, 0xE, 0, 0xf7
-  };
+static inline int paint_core(const struct launchpad_output *output) {
+  return output->is_host ? 1 : 0;
+}
 
+// The most pads we can set in a single "light LEDs" message.
+#define MK2_MAX_LEDS_PER_MESSAGE 80
 
-  // Here's what we'll eventually use for everything in one pass....
-
-  /*
-    F0h 00h 20h 29h 02h 10h 0Fh <Grid Type> <Red> <Green> <Blue> F7h
-    (240, 0, 32, 41, 2, 16, 15, <Grid Type>, <Red>, <Green>, <Blue>, 247)
-    The <Red> <Green> <Blue> group may be repeated in the message up to 100 times.
-    <Grid Type> - 0 for 10 by 10 grid, 1 for 8 by 8 grid (central square pads only)
-  */
-
-//   uint8_t paint_all_sysex[309] = {
-//     0xf0, 0, 0x20, 0x29, 0x2, 0x10, // sysex header plus device/mfr.
-//     0xF, // type of message
-//     0, // Grid type
-//     // 10 rows, 10 cells, 3 colours per cell
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//     0xf7 // end sysex message
-//   };
-
-  // Paint a Column, same deal about the colour palette.
-  // F0h 00h 20h 29h 02h 10h 0Ch <Column> (<Colour> * 10) F7h
-  uint8_t paint_column[19] = {
-    0xf0, 0, 0x20, 0x29, 0x2, 0x10, 0xC, board_state->active_column, 
-    3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
-    0xf7
-  };
+// Big enough for the longest message we send, a full 10 x 10 RGB frame.
+#define MK2_MAX_FRAME_LENGTH 309
 
-  // Paint a Row, same deal about the colour palette.
-  // F0h 00h 20h 29h 02h 10h 0Dh <Row> (<Colour> * 10) F7h
-  uint8_t paint_row[19] = {
-    0xf0, 0, 0x20, 0x29, 0x2, 0x10, 0xD, board_state->active_row, 
-    3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
-    0xf7
-  };
- 
-  // We currently use the "pulse" method.
-  uint8_t paint_side_light[12] = {
-    0xf0, 0x00, 0x20, 0x29, 0x2, 0x10, 0x28, 0x63, 3, 0xf7
-  };
+static uint8_t mk2_frame_sysex[PAINT_CORES][MK2_MAX_FRAME_LENGTH];
 
-  // The virtual port for the MK2 should be cable 1.
-  tud_midi_stream_write(1, paint_all_sysex, sizeof(paint_all_sysex));
-  tud_midi_stream_write(1, paint_side_light, sizeof(paint_side_light));
-  tud_midi_stream_write(1, paint_column, sizeof(paint_column));
-  tud_midi_stream_write(1, paint_row, sizeof(paint_row));
+// The MK2 flashes a pad between the colour it already has and the flash
+// colour, so pads it animates by itself are painted black underneath.
+static inline struct led_colour mk2_static_colour(const struct device_profile *profile, const struct led_frame *frame, int index) {
+  return device_effect(profile, frame, index) ? LED_COLOUR_BLACK : frame->cells[index];
 }
 
-void paint_mk3_client_launchpads(struct board_state *board_state) {
+// Encode whatever has changed since the last frame as a single sysex message,
+// using whichever of these is shortest:
+//
+// Light LEDs (RGB): F0h 00h 20h 29h 02h 10h 0Bh <LED> <Red> <Green> <Blue> F7h
+//   The <LED> <Red> <Green> <Blue> group may be repeated up to 80 times.
+//
+// Grid (RGB): F0h 00h 20h 29h 02h 10h 0Fh <Grid Type> <Red> <Green> <Blue> F7h
+//   The <Red> <Green> <Blue> group may be repeated in the message up to 100 times.
+//   <Grid Type> - 0 for 10 by 10 grid, 1 for 8 by 8 grid (central square pads only)
+//
+// Both grids are filled from the bottom left, one row at a time, so they use the
+// same order as our frames.  Returns the number of bytes written, which is zero
+// if nothing has changed.  Sets is_grid if we used a grid, which stops any
+// effects on the pads it covers.
+static size_t encode_mk2_frame(const struct launchpad_output *output, const struct led_shadow *shadow, const struct led_frame *frame, uint8_t *buffer, bool *is_grid) {
+  const struct device_profile *profile = output->profile;
+  int changed_pads = 0;
+  bool is_centre_only = true;
+
+  *is_grid = false;
+
+  for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+    if (is_cell_changed(profile, shadow, frame, index)) {
+      changed_pads++;
+      is_centre_only = is_centre_only && is_centre_cell(index);
+    }
+  }
 
-  // TODO: We should eventually use this method instead.
-  /*
+  if (changed_pads == 0) {
+    return 0;
+  }
 
-    Host => Launchpad Pro [MK3]:
-    Hex Version: F0h 00h 20h 29h 02h 0Eh 03h <Colour Spec> [ <Colour Spec> [_] ] F7h
-    Decimal Version: 240 0 32 41 2 14 3 <Colour Spec> [ <Colour Spec> [_] ] 247
+  // Each message has a seven byte header and a one byte footer.  Anything we
+  // can't use is treated as being as long as a full frame.
+  int leds_length = changed_pads <= MK2_MAX_LEDS_PER_MESSAGE ? 8 + (4 * changed_pads) : MK2_MAX_FRAME_LENGTH;
+  bool is_grid_supported = (profile->encodings & LAUNCHPAD_ENCODING_RGB_GRID) != 0;
+  int centre_length = is_grid_supported && is_centre_only ? 9 + (3 * 64) : MK2_MAX_FRAME_LENGTH;
+
+  size_t length = 0;
+  buffer[length++] = 0xF0;
+  buffer[length++] = 0x00;
+  buffer[length++] = 0x20;
+  buffer[length++] = 0x29;
+  buffer[length++] = 0x02;
+  buffer[length++] = profile->sysex_model_id;
+
+  if (leds_length <= centre_length && leds_length < MK2_MAX_FRAME_LENGTH) {
+    buffer[length++] = 0x0B;
+
+    for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+      if (is_cell_changed(profile, shadow, frame, index)) {
+        buffer[length++] = index;
+        append_mk2_rgb(buffer, &length, mk2_static_colour(profile, frame, index));
+      }
+    }
+  }
+  else if (centre_length < MK2_MAX_FRAME_LENGTH) {
+    buffer[length++] = 0x0F;
+    buffer[length++] = 1;
+    *is_grid = true;
 
+    for (int cell = 0; cell < GRID_CENTRE_CELLS; cell++) {
+      append_mk2_rgb(buffer, &length, mk2_static_colour(profile, frame, grid_centre_cells[cell]));
+    }
+  }
+  else {
+    buffer[length++] = 0x0F;
+    buffer[length++] = 0;
+    *is_grid = true;
 
-    The <Colour Spec> is structured as follows:
-    - Lighting type (1 byte)
-    - LED index (1 byte)
-    - Lighting data (1 – 3 bytes)
+    for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+      append_mk2_rgb(buffer, &length, mk2_static_colour(profile, frame, index));
+    }
+  }
 
-    Lighting types:
+  buffer[length++] = 0xF7;
 
-        Hex: 00h / Decimal: 0 --- Static colour from palette, Lighting data is 1 byte specifying
-        palette entry.
-        Hex: 01h / Decimal: 1 --- Flashing colour, Lighting data is 2 bytes specifying Colour B and
-        Colour A.
-        Hex: 02h / Decimal: 2 --- Pulsing colour, Lighting data is 1 byte specifying palette entry.
-        Hex: 03h / Decimal: 3 --- RGB colour, Lighting data is 3 bytes for Red, Green and Blue (127:
-    Max, 0: Min).
+  return length;
+}
 
-        [The 1 byte colours are the same palette they use from the MK2, i.e. white is 0x03]
-        [The 3 byte colours are similar to the MK2 scheme, 0-127 for each of R, G, and B.]
+// Start the effect on every pad that needs it, as many messages as it takes:
+//
+// Flash LED: F0h 00h 20h 29h 02h 10h 23h <LED> <Colour> F7h
+// Pulse LED: F0h 00h 20h 29h 02h 10h 28h <LED> <Colour> F7h
+//   The <LED> <Colour> group may be repeated, and the colour is from the palette.
+static void write_mk2_effects(const struct launchpad_output *output, const struct led_shadow *shadow, const struct led_frame *frame, uint8_t effect, uint8_t command, bool is_grid, uint8_t *buffer) {
+  const struct device_profile *profile = output->profile;
+
+  int index = 0;
+  while (index < LAUNCHPAD_GRID_CELLS) {
+    size_t length = 0;
+    buffer[length++] = 0xF0;
+    buffer[length++] = 0x00;
+    buffer[length++] = 0x20;
+    buffer[length++] = 0x29;
+    buffer[length++] = 0x02;
+    buffer[length++] = profile->sysex_model_id;
+    buffer[length++] = command;
+
+    int led_count = 0;
+    for (; index < LAUNCHPAD_GRID_CELLS && led_count < MK2_MAX_LEDS_PER_MESSAGE; index++) {
+      if (device_effect(profile, frame, index) == effect && (is_grid || is_cell_changed(profile, shadow, frame, index))) {
+        buffer[length++] = index;
+        buffer[length++] = frame->effect_colours[index];
+        led_count++;
+      }
+    }
 
-  */
+    if (led_count == 0) {
+      return;
+    }
 
-//   // We don't know what things looked like before, so we have to paint all 100
-//   // cells we use. 
-//   for (int row = 5; row < 6; row++) {
-//     // We're using the indexed colour scheme, so we need 7 bytes for the header, 3
-//     // bytes for each pad, and 1 for the footer.
-//     uint8_t paint_row[38] = {
-//     0xF0, 0x00, 0x20, 0x29, 0x02, 0x0E, 0x03, // Mfr. header and command identifier.    
-//     };
-//     paint_row[17] = 0xF7; // Footer
+    buffer[length++] = 0xF7;
+    write_to_output(output, buffer, length);
+  }
+}
 
-//     int buffer_index = 7;
+static void paint_mk2(const struct launchpad_output *output, struct led_shadow *shadow, const struct led_frame *frame) {
+  uint8_t *frame_sysex = mk2_frame_sysex[paint_core(output)];
 
+  const struct device_profile *profile = output->profile;
+  bool is_side_light_changed = is_cell_changed(profile, shadow, frame, MK2_SIDE_LIGHT);
 
-//     int row_offset = row == 0 ? 100 : (row * 10);
-//     for (int col = 0; col < 10; col++) {
-//         int note = row_offset + col;
+  bool is_grid = false;
+  size_t length = encode_mk2_frame(output, shadow, frame, frame_sysex, &is_grid);
 
-//         // Lighting type
-//         paint_row[buffer_index] = 0x00;
-//         buffer_index++;
+  // Any pad whose effect has changed was painted above, so there's nothing to
+  // start if nothing was.
+  if (length > 0) {
+    write_to_output(output, frame_sysex, length);
+    write_mk2_effects(output, shadow, frame, LAUNCHPAD_EFFECT_FLASH, 0x23, is_grid, frame_sysex);
+    write_mk2_effects(output, shadow, frame, LAUNCHPAD_EFFECT_PULSE, 0x28, is_grid, frame_sysex);
+  }
 
-//         // LED index
-//         paint_row[buffer_index] = note;
-//         buffer_index++;
+  // When the side light isn't part of the picture, we "pulse" it white instead.
+  // A grid stops the pulse along with every other effect, so we start it again.
+  // F0h 00h 20h 29h 02h 10h 28h <LED> <Colour> F7h
+  if ((is_side_light_changed || is_grid) && led_colour_equals(frame->cells[MK2_SIDE_LIGHT], LED_COLOUR_BLACK) && !device_effect(profile, frame, MK2_SIDE_LIGHT)) {
+    uint8_t pulse_side_light[10] = {
+      0xf0, 0x00, 0x20, 0x29, 0x2, profile->sysex_model_id, 0x28, MK2_SIDE_LIGHT, palette_index_for_colour(LED_COLOUR_WHITE), 0xf7
+    };
 
-//         // Lighting data
-//         int color = (row == board_state->active_row || col == board_state->active_column) ? 0x03 : 0x00;
-//         paint_row[buffer_index] = color;
-//         buffer_index++;
-//     }
+    write_to_output(output, pulse_side_light, sizeof(pulse_side_light));
+  }
 
-//     // The virtual port for the MK3 should be cable 2.
-//     tud_midi_stream_write(2, paint_row, sizeof(paint_row));
-//   }
+  shadow->frame = *frame;
+  shadow->is_valid = true;
+}
 
-    // Write note messages for the host side until we figure out sysex there.
-    for (int note = 1; note < 99; note++) {
-        int note_col = note % 10;
-        int note_row = (note - note_col)/10;
+/*
+  The MK3 can set any number of pads in a single sysex message:
+
+  Host => Launchpad Pro [MK3]:
+  Hex Version: F0h 00h 20h 29h 02h 0Eh 03h <Colour Spec> [ <Colour Spec> [_] ] F7h
+  Decimal Version: 240 0 32 41 2 14 3 <Colour Spec> [ <Colour Spec> [_] ] 247
+
+
+  The <Colour Spec> is structured as follows:
+  - Lighting type (1 byte)
+  - LED index (1 byte)
+  - Lighting data (1 – 3 bytes)
+
+  Lighting types:
+
+      Hex: 00h / Decimal: 0 --- Static colour from palette, Lighting data is 1 byte specifying
+      palette entry.
+      Hex: 01h / Decimal: 1 --- Flashing colour, Lighting data is 2 bytes specifying Colour B and
+      Colour A.
+      Hex: 02h / Decimal: 2 --- Pulsing colour, Lighting data is 1 byte specifying palette entry.
+      Hex: 03h / Decimal: 3 --- RGB colour, Lighting data is 3 bytes for Red, Green and Blue (127:
+  Max, 0: Min).
+
+      [The 1 byte colours are the same palette they use from the MK2, i.e. white is 0x03]
+      [The 3 byte colours are similar to the MK2 scheme, 0-127 for each of R, G, and B.]
+*/
+
+// USB MIDI carries sysex three bytes at a time in four byte events, with the
+// last event holding whatever is left, and sends up to 16 events in each 64
+// byte bulk packet.  We keep each message, header and footer included, to at
+// most four packets' worth of events, so that other messages can be slotted in
+// between them, and pick which pads go in each message so that it fills those
+// events exactly where we can, see arrange_mk3_message.
+#define MK3_MAX_MESSAGE_EVENTS (4 * 16)
+#define MK3_MAX_MESSAGE_LENGTH (MK3_MAX_MESSAGE_EVENTS * 3)
+
+// The seven byte header and the F7 at the end.
+#define MK3_MESSAGE_OVERHEAD 8
+
+static struct mk3_colour_spec mk3_specs[PAINT_CORES][LAUNCHPAD_GRID_CELLS];
+static uint8_t mk3_messages[PAINT_CORES][MK3_MAX_MESSAGE_LENGTH];
+
+static int mk3_colour_spec_length(const struct mk3_colour_spec *spec) {
+  switch (spec->lighting_type) {
+    case MK3_LIGHTING_FLASHING:
+      return 4;
+    case MK3_LIGHTING_RGB:
+      return 5;
+    default:
+      return 3;
+  }
+}
 
-        uint8_t velocity = (note_col == board_state->active_column || note_row == board_state->active_row) ? 3 : 0;
+// Use a palette colour when there's one that matches exactly, as it's two
+// bytes shorter than the RGB equivalent.
+static struct mk3_colour_spec mk3_colour_spec_for(uint8_t led_index, struct led_colour colour) {
+  struct mk3_colour_spec spec = { MK3_LIGHTING_RGB, led_index, { colour.red, colour.green, colour.blue } };
 
-        uint8_t note_on_message[3] = {
-        MIDI_CIN_NOTE_ON << 4, note, velocity
-        };
+  uint8_t palette_index = palette_index_for_colour(colour);
+  if (led_colour_equals(novation_palette[palette_index], colour)) {
+    spec.lighting_type = MK3_LIGHTING_STATIC;
+    spec.data[0] = palette_index;
+  }
 
-        tud_midi_stream_write(2, note_on_message, sizeof(note_on_message));
-    }
+  return spec;
+}
 
+// Pads the device animates by itself flash between the colour and black, or
+// pulse the colour.
+static struct mk3_colour_spec mk3_colour_spec_for_cell(const struct device_profile *profile, const struct led_frame *frame, int index) {
+  switch (device_effect(profile, frame, index)) {
+    case LAUNCHPAD_EFFECT_FLASH:
+      return (struct mk3_colour_spec) { MK3_LIGHTING_FLASHING, index, { 0, frame->effect_colours[index], 0 } };
+    case LAUNCHPAD_EFFECT_PULSE:
+      return (struct mk3_colour_spec) { MK3_LIGHTING_PULSING, index, { frame->effect_colours[index], 0, 0 } };
+    default:
+      return mk3_colour_spec_for(index, frame->cells[index]);
+  }
 }
 
-void paint_host_launchpad(struct board_state *board_state) {
-    if (board_state->host.launchpad_version == MK1) {
-        paint_mk1_host_launchpad(board_state);
-    }
-    else if (board_state->host.launchpad_version == MK2) {
-        paint_mk2_host_launchpad(board_state);
+size_t encode_mk3_colour_specs(uint8_t sysex_model_id, const struct mk3_colour_spec *specs, int spec_count, uint8_t *buffer, int *specs_encoded) {
+  size_t length = 0;
+  buffer[length++] = 0xF0;
+  buffer[length++] = 0x00;
+  buffer[length++] = 0x20;
+  buffer[length++] = 0x29;
+  buffer[length++] = 0x02;
+  buffer[length++] = sysex_model_id;
+  buffer[length++] = 0x03;
+
+  int spec_index = 0;
+  for (; spec_index < spec_count; spec_index++) {
+    const struct mk3_colour_spec *spec = &specs[spec_index];
+    int spec_length = mk3_colour_spec_length(spec);
+
+    // Leave room for the footer.
+    if (length + spec_length + 1 > MK3_MAX_MESSAGE_LENGTH) {
+      break;
     }
-    else if (board_state->host.launchpad_version == MK3) {
-        paint_mk3_host_launchpad(board_state);
+
+    buffer[length++] = spec->lighting_type;
+    buffer[length++] = spec->led_index;
+    for (int data_index = 0; data_index < spec_length - 2; data_index++) {
+      buffer[length++] = spec->data[data_index];
     }
+  }
+
+  buffer[length++] = 0xF7;
+
+  *specs_encoded = spec_index;
+  return length;
 }
 
-// TODO: When we figure out sending sysex to the host's client device, we can simplify this.
-void paint_mk1_host_launchpad(struct board_state *board_state) {
-    // We use a different strategy here because the MK1 units skip notes between rows.
-    for (int row = 0; row < 8; row++) {
-        for (int col = 0; col < 8; col++) {
-        int note = (row * 16) + col;
+static void swap_mk3_colour_specs(struct mk3_colour_spec *a, struct mk3_colour_spec *b) {
+  struct mk3_colour_spec swapped = *a;
+  *a = *b;
+  *b = swapped;
+}
 
-        uint8_t velocity = (col == board_state->active_column || row == board_state->active_row) ? 3 : 0;
+// Move the specs that should go in the next message to the front, so that
+// encode_mk3_colour_specs picks them up.  The order of the pads within a frame
+// doesn't matter, so rather than taking them in order and leaving whatever
+// room is left over at the end of the message, we look for the mix of three,
+// four and five byte specs that fills as much of the message as possible.  If
+// there are enough of each, that's all MK3_MAX_MESSAGE_EVENTS events, so the
+// message is a run of whole bulk packets.  The last message of a frame takes
+// whatever is left.
+static void arrange_mk3_message(struct mk3_colour_spec *specs, int spec_count) {
+  int room = MK3_MAX_MESSAGE_LENGTH - MK3_MESSAGE_OVERHEAD;
+
+  // How many specs there are of each length, 3 to 5 bytes.
+  int available[6] = { 0 };
+  int total_length = 0;
+  for (int spec_index = 0; spec_index < spec_count; spec_index++) {
+    int spec_length = mk3_colour_spec_length(&specs[spec_index]);
+    available[spec_length]++;
+    total_length += spec_length;
+  }
 
-        uint8_t note_on_message[3] = {
-            MIDI_CIN_NOTE_ON << 4, note, velocity
-        };
+  if (total_length <= room) {
+    return;
+  }
 
-        tuh_midi_stream_write(board_state->host.client_idx, 0, note_on_message, sizeof(note_on_message));
-        }
+  // Try every number of four and five byte specs, and fill the rest with three
+  // byte ones.  That's a few hundred sums at most, only for frames that need
+  // more than one message.
+  int wanted[6] = { 0 };
+  int best_length = -1;
+  for (int fives = 0; fives <= available[5] && (fives * 5) <= room && best_length < room; fives++) {
+    for (int fours = 0; fours <= available[4] && (fives * 5) + (fours * 4) <= room; fours++) {
+      int threes = (room - (fives * 5) - (fours * 4)) / 3;
+      threes = threes < available[3] ? threes : available[3];
+
+      int length = (fives * 5) + (fours * 4) + (threes * 3);
+      if (length > best_length) {
+        best_length = length;
+        wanted[3] = threes;
+        wanted[4] = fours;
+        wanted[5] = fives;
+      }
     }
+  }
+
+  int front = 0;
+  for (int spec_index = 0; spec_index < spec_count; spec_index++) {
+    int spec_length = mk3_colour_spec_length(&specs[spec_index]);
+    if (wanted[spec_length] > 0) {
+      wanted[spec_length]--;
+      swap_mk3_colour_specs(&specs[front++], &specs[spec_index]);
+    }
+  }
 }
 
-// TODO: When we figure out sending sysex to the host's client device, we can simplify this.
-void paint_mk2_host_launchpad(struct board_state *board_state) {
-    // Write note messages for the host side until we figure out sysex there.
-    for (int note = 1; note < 99; note++) {
-        int note_col = note % 10;
-        int note_row = (note - note_col)/10;
+static void paint_mk3(const struct launchpad_output *output, struct led_shadow *shadow, const struct led_frame *frame) {
+  struct mk3_colour_spec *specs = mk3_specs[paint_core(output)];
+  uint8_t *message = mk3_messages[paint_core(output)];
 
-        uint8_t velocity = (note_col == board_state->active_column || note_row == board_state->active_row) ? 3 : 0;
+  const struct pad_address *pads = get_pad_layout(output->profile->note_layout)->pad_for_cell;
 
-        uint8_t note_on_message[3] = {
-        MIDI_CIN_NOTE_ON << 4, note, velocity
-        };
+  int spec_count = 0;
+  bool is_static_only = true;
+  for (int index = 0; index < LAUNCHPAD_GRID_CELLS; index++) {
+    if (pads[index].status && is_cell_changed(output->profile, shadow, frame, index)) {
+      specs[spec_count] = mk3_colour_spec_for_cell(output->profile, frame, index);
+      is_static_only = is_static_only && specs[spec_count].lighting_type == MK3_LIGHTING_STATIC;
+      spec_count++;
+    }
+  }
 
-        // tuh_midi_stream_write(board_state->host.client_idx, 1, note_on_message, sizeof(note_on_message));
-        tuh_midi_stream_write(0, 1, note_on_message, sizeof(note_on_message));
+  // A static colour takes one USB MIDI event whether we send it as a note on
+  // (or control change, for the buttons around the edge) or as part of a sysex
+  // message, so if there's nothing else to send, we skip the sysex header and
+  // footer and use notes.
+  if (is_static_only && (output->profile->encodings & LAUNCHPAD_ENCODING_PALETTE_NOTES)) {
+    for (int spec_index = 0; spec_index < spec_count; spec_index++) {
+      write_pad(output, &pads[specs[spec_index].led_index], specs[spec_index].data[0]);
     }
-}
+  }
+  else {
+    int specs_written = 0;
+    while (specs_written < spec_count) {
+      int specs_encoded = 0;
+      arrange_mk3_message(specs + specs_written, spec_count - specs_written);
+      size_t length = encode_mk3_colour_specs(output->profile->sysex_model_id, specs + specs_written, spec_count - specs_written, message, &specs_encoded);
+      write_to_output(output, message, length);
+      specs_written += specs_encoded;
+    }
+  }
 
-// TODO: When we figure out sending sysex to the host's client device, we can
-// simplify this by using their sysex strategy (see the client implementation).
-void paint_mk3_host_launchpad(struct board_state *board_state) {
-    // Write note messages for the host side until we figure out sysex there.
-    for (int note = 1; note < 99; note++) {
-        int note_col = note % 10;
-        int note_row = (note - note_col)/10;
+  shadow->frame = *frame;
+  shadow->is_valid = true;
+}
 
-        uint8_t velocity = (note_col == board_state->active_column || note_row == board_state->active_row) ? 3 : 0;
+typedef void (*paint_function)(const struct launchpad_output*, struct led_shadow*, const struct led_frame*);
 
-        uint8_t note_on_message[3] = {
-        MIDI_CIN_NOTE_ON << 4, note, velocity
-        };
+// How we paint each generation.
+static const paint_function paint_functions[] = {
+  [UNkNOWN] = NULL,
+  [MK1] = paint_mk1,
+  [MK2] = paint_mk2,
+  [MK3] = paint_mk3
+};
 
-        // The MK3 wants data on the first cable, i.e. "MIDI" and not "DIN" or "DAW"
-        tuh_midi_stream_write(board_state->host.client_idx, 0, note_on_message, sizeof(note_on_message));
-    }
+static struct packet_queue *output_queue(const struct launchpad_output *output) {
+  return output->is_host ? &host_queues[output->client_idx] : &client_queues[output->cable];
 }
 
-void process_incoming_host_packet(uint8_t *incoming_packet, struct board_state *board_state) {
-    if (board_state->host.launchpad_version == MK1) {
-        process_incoming_mk1_packet(incoming_packet, board_state);
+// If we've made the same change on the same type of device before, send the
+// packets we sent then.  Otherwise, encode the frame as usual, and keep the
+// packets that came out for next time.
+static void paint_output(const struct launchpad_output *output, struct led_shadow *shadow, const struct led_frame *frame, uint32_t frame_hash, struct frame_cache *cache) {
+  paint_function paint = paint_functions[output->profile->launchpad_version];
+  if (!paint) {
+    return;
+  }
+
+  struct packet_queue *queue = output_queue(output);
+  struct frame_cache_key key = {
+    output->profile, output->cable, shadow->is_valid, shadow->displayed_buffer, shadow->frame_hash, frame_hash
+  };
+
+  const struct frame_cache_entry *cached = frame_cache_find(cache, &key, &shadow->frame, frame);
+  if (cached) {
+    if (packet_queue_push_packets(queue, cached->packets, cached->packet_count)) {
+      shadow->frame = *frame;
+      shadow->is_valid = true;
+      shadow->displayed_buffer = cached->displayed_buffer;
+      shadow->frame_hash = frame_hash;
     }
-    else if (board_state->host.launchpad_version == MK2) {
-        process_incoming_mk2_packet(incoming_packet, board_state);
+    else {
+      shadow->is_valid = false;
     }
-    else if (board_state->host.launchpad_version == MK3) {
-        process_incoming_mk3_packet(incoming_packet, board_state);
+    return;
+  }
+
+  // The paint functions update the shadow, and the cache needs what it was.
+  cache->previous_frame = shadow->frame;
+  uint32_t pushed_before = queue->pushed_packets;
+  uint32_t dropped_before = queue->dropped_messages;
+
+  paint(output, shadow, frame);
+  shadow->frame_hash = frame_hash;
+
+  // Only keep frames that went out in full.  If part of the frame was dropped,
+  // the paint functions don't know, so we make sure the whole device is
+  // painted again next time.
+  uint32_t packet_count = queue->pushed_packets - pushed_before;
+  if (queue->dropped_messages != dropped_before) {
+    shadow->is_valid = false;
+  }
+  else if (packet_count <= FRAME_CACHE_MAX_PACKETS) {
+    struct frame_cache_entry *entry = frame_cache_add(cache, &key, &cache->previous_frame, frame);
+    packet_queue_copy_newest(queue, entry->packets, packet_count);
+    entry->packet_count = packet_count;
+    entry->displayed_buffer = shadow->displayed_buffer;
+  }
+}
+
+void paint_client_launchpads(const struct led_frame *frame) {
+  uint32_t frame_hash = led_frame_hash(frame);
+  for (uint8_t cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    struct launchpad_output output = client_output(cable);
+    paint_output(&output, &client_shadows[cable], frame, frame_hash, &client_frame_cache);
+  }
+
+  // Start timing the frame on every cable it touched.
+  for (int cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    packet_queue_mark_frame(&client_queues[cable], frame->input_time);
+  }
+
+  // Send as much as we can straight away.
+  service_client_launchpads();
+}
+
+void initialise_host_launchpad(uint8_t client_idx, enum LaunchpadModel model) {
+    // Anything left over from a previous device is no longer relevant.
+    packet_queue_clear(&host_queues[client_idx]);
+
+    // We don't know what's on the new device yet, so we have to repaint all of it.
+    invalidate_host_shadow(client_idx);
+
+    const struct device_profile *profile = get_device_profile(model);
+    host_profiles[client_idx] = profile->launchpad_version == UNkNOWN ? NULL : profile;
+    is_host_attached[client_idx] = true;
+
+    if (host_profiles[client_idx]) {
+        struct launchpad_output output = { true, client_idx, profile->host_cable, profile };
+        initialise_output(&output);
     }
+
+    publish_host_stats(client_idx);
 }
 
-void process_incoming_client_packet(uint8_t *incoming_packet, struct board_state *board_state) {
-    uint8_t cable = (incoming_packet[0] >> 4) & 0xf;
+void release_host_launchpad(uint8_t client_idx) {
+    host_profiles[client_idx] = NULL;
+    is_host_attached[client_idx] = false;
+    host_sysex_packet_counts[client_idx] = 0;
+    packet_queue_clear(&host_queues[client_idx]);
+    invalidate_host_shadow(client_idx);
+    publish_host_stats(client_idx);
+}
+
+// Everything to do with host output (initialising, painting and servicing
+// devices) runs on core1, between calls to tuh_task, so that only one core
+// ever drives the host stack.
+void paint_host_launchpads(const struct led_frame *frame) {
+    uint32_t frame_hash = led_frame_hash(frame);
+    for (uint8_t client_idx = 0; client_idx < MAX_HOST_LAUNCHPADS; client_idx++) {
+        const struct device_profile *profile = host_profiles[client_idx];
+        if (profile) {
+            struct launchpad_output output = { true, client_idx, profile->host_cable, profile };
+            paint_output(&output, &host_shadows[client_idx], frame, frame_hash, &host_frame_cache);
+        }
 
-    // MK1
-    if (cable == 0) {
-      process_incoming_mk1_packet(incoming_packet, board_state);
+        packet_queue_mark_frame(&host_queues[client_idx], frame->input_time);
+        publish_host_stats(client_idx);
     }
-    // MK2
-    else if (cable == 1) {
-      process_incoming_mk2_packet(incoming_packet, board_state);
+}
+
+// The most packets we hand to a single device before moving on to the next,
+// i.e. one full speed bulk packet.
+#define HOST_PACKETS_PER_TURN 16
+
+// Move queued packets into the TinyUSB FIFO for each device.  The devices take
+// turns, one bulk packet at a time, so that a device that's slow to accept
+// data only holds up its own queue.
+void service_host_launchpads(void) {
+    uint8_t packets[HOST_PACKETS_PER_TURN * USB_MIDI_PACKET_SIZE];
+    bool is_written[MAX_HOST_LAUNCHPADS] = { false };
+
+    bool is_progressing = true;
+    while (is_progressing) {
+        is_progressing = false;
+
+        for (uint8_t client_idx = 0; client_idx < MAX_HOST_LAUNCHPADS; client_idx++) {
+            struct packet_queue *queue = &host_queues[client_idx];
+            if (queue->count == 0 || !is_host_attached[client_idx]) {
+                continue;
+            }
+
+            uint32_t available_packets = tuh_midi_write_available(client_idx) / USB_MIDI_PACKET_SIZE;
+            uint16_t max_packets = available_packets < HOST_PACKETS_PER_TURN ? available_packets : HOST_PACKETS_PER_TURN;
+            if (max_packets == 0) {
+                continue;
+            }
+
+            uint16_t packet_count = packet_queue_peek(queue, packets, max_packets);
+            uint32_t written_bytes = tuh_midi_packet_write_n(client_idx, packets, packet_count * USB_MIDI_PACKET_SIZE);
+            packet_queue_pop(queue, written_bytes / USB_MIDI_PACKET_SIZE);
+            packet_queue_check_frame_sent(queue, time_us_32());
+
+            if (written_bytes > 0) {
+                is_written[client_idx] = true;
+                is_progressing = true;
+            }
+        }
     }
-    // MK3
-    else if (cable == 2) {
-      process_incoming_mk3_packet(incoming_packet, board_state);
+
+    // Send anything that doesn't fill a whole packet.
+    for (uint8_t client_idx = 0; client_idx < MAX_HOST_LAUNCHPADS; client_idx++) {
+        if (is_written[client_idx]) {
+            tuh_midi_write_flush(client_idx);
+            publish_host_stats(client_idx);
+        }
     }
 }
 
+// How each control moves the cross, as a change of row and column.
+static const int8_t control_moves[LAUNCHPAD_CONTROL_COUNT][2] = {
+  [LAUNCHPAD_CONTROL_NONE] = { 0, 0 },
+  [LAUNCHPAD_CONTROL_UP] = { 1, 0 },
+  [LAUNCHPAD_CONTROL_DOWN] = { -1, 0 },
+  [LAUNCHPAD_CONTROL_LEFT] = { 0, -1 },
+  [LAUNCHPAD_CONTROL_RIGHT] = { 0, 1 }
+};
+
+// Respond to controls on any model, using its profile to look up what each
+// controller does.
+static void process_incoming_packet(const struct device_profile *profile, const uint8_t *incoming_packet, struct board_state *board_state) {
+  if (profile->launchpad_version == UNkNOWN) {
+    return;
+  }
 
-// Respond to MK1 (Launchpad S) controls
-void process_incoming_mk1_packet (uint8_t *incoming_packet, struct board_state *board_state) {
   uint8_t data[3];
   memcpy(data, incoming_packet + 1, 3);
-  
-  // Start with the message type
-  int type = data[0] >> 4;
-
-  if (type == MIDI_CIN_CONTROL_CHANGE) {
-    // Only react when a control is changed to a non-zero value, i.e. when it's pressed, and not when it's released.
-    if (data[2]) {
-      switch(data[1]) {
-        // Upward arrow
-        case 104:
-          board_state->active_row = (board_state->active_row + 1) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Downward arrow
-        case 105:
-          board_state->active_row = (board_state->active_row + 9) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Left Arrow
-        case 106:
-          board_state->active_column = (board_state->active_column + 9) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Right Arrow
-        case 107:
-          board_state->active_column = (board_state->active_column + 1) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Ignore everything else
-        default:
-          break;
-      }
-    }
+
+  // Only react when a pad or control is pressed, and not when it's released.
+  if (data[2] == 0) {
+    return;
   }
-}
 
-// Respond to MK2 controls
-void process_incoming_mk2_packet (uint8_t *incoming_packet, struct board_state *board_state) {
-  uint8_t data[3];
-  memcpy(data, incoming_packet + 1, 3);
-  
-  // Start with the message type
-  int type = data[0] >> 4;
-
-  if (type == MIDI_CIN_CONTROL_CHANGE) {
-    // Only react when a control is changed to a non-zero value, i.e. when it's pressed, and not when it's released.
-    if (data[2]) {
-      switch(data[1]) {
-        // Upward arrow
-        case 91:
-          board_state->active_row = (board_state->active_row + 1) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Downward arrow
-        case 92:
-          board_state->active_row = (board_state->active_row + 9) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Left Arrow
-        case 93:
-          board_state->active_column = (board_state->active_column + 9) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Right Arrow
-        case 94:
-          board_state->active_column = (board_state->active_column + 1) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Ignore everything else
-        default:
-          break;
-      }
+  // Pressing a pad moves the cross to it.
+  if ((data[0] >> 4) == MIDI_CIN_NOTE_ON) {
+    int cell = get_pad_layout(profile->note_layout)->cell_for_note[data[1] & 0x7F];
+    if (cell != PAD_LAYOUT_NO_CELL) {
+      board_state->active_row = grid_cell_rows[cell];
+      board_state->active_column = grid_cell_columns[cell];
+      board_state->is_dirty = true;
     }
+    return;
   }
-}
 
-// Respond to MK3 controls
-void process_incoming_mk3_packet (uint8_t *incoming_packet, struct board_state *board_state) {
-  uint8_t data[3];
-  memcpy(data, incoming_packet + 1, 3);
-  
-  // Start with the message type
-  int type = data[0] >> 4;
-
-  if (type == MIDI_CIN_CONTROL_CHANGE) {
-    // Only react when a control is changed to a non-zero value, i.e. when it's pressed, and not when it's released.
-    if (data[2]) {
-      switch(data[1]) {
-        // Upward arrow
-        case 80:
-          board_state->active_row = (board_state->active_row + 1) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Downward arrow
-        case 70:
-          board_state->active_row = (board_state->active_row + 9) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Left Arrow
-        case 91:
-          board_state->active_column = (board_state->active_column + 9) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Right Arrow
-        case 92:
-          board_state->active_column = (board_state->active_column + 1) % 10;
-          board_state->is_dirty = true;
-          break;
-        // Ignore everything else
-        default:
-          break;
-      }
-    }
+  if ((data[0] >> 4) != MIDI_CIN_CONTROL_CHANGE) {
+    return;
+  }
+
+  uint8_t control = profile->controls[data[1] & 0x7F];
+  if (control == LAUNCHPAD_CONTROL_NONE) {
+    return;
   }
+
+  board_state->active_row = (board_state->active_row + LAUNCHPAD_GRID_SIZE + control_moves[control][0]) % LAUNCHPAD_GRID_SIZE;
+  board_state->active_column = (board_state->active_column + LAUNCHPAD_GRID_SIZE + control_moves[control][1]) % LAUNCHPAD_GRID_SIZE;
+  board_state->is_dirty = true;
 }
 
-enum LaunchpadVersion get_launchpad_version (uint16_t idVendor, uint16_t idProduct) {
-  enum LaunchpadVersion launchpad_version;
-  launchpad_version = UNkNOWN;
+void process_incoming_host_packet(uint8_t client_idx, uint8_t *incoming_packet, struct board_state *board_state) {
+    const struct device_profile *profile = get_device_profile(board_state->host.devices[client_idx].model);
+    process_incoming_packet(profile, incoming_packet, board_state);
+}
 
-  if (idVendor == 0x1235) {
-    if (idProduct == 0x000E) {
-      launchpad_version = MK1;
-    }
-    else if (idProduct >= 0x0051 && idProduct <= 0x0060) {
-      launchpad_version = MK2;
-    }
-    else if (idProduct >= 0x0123 && idProduct <= 0x0132) {
-      launchpad_version = MK3;
-    }
-  }
+void process_incoming_client_packet(uint8_t *incoming_packet, struct board_state *board_state) {
+    uint8_t cable = (incoming_packet[0] >> 4) & 0xf;
 
-  return launchpad_version;
-}
\ No newline at end of file
+    if (cable < CFG_TUD_MIDI_NUMCABLES_OUT) {
+      process_incoming_packet(get_device_profile(client_models[cable]), incoming_packet, board_state);
+    }
+}
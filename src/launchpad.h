@@ -6,18 +6,103 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "device_profile.h"
+#include "packet_queue.h"
+
+// We work with a logical 10 x 10 grid that uses the same numbering as the
+// "programmer" layout on the MK2 and MK3, i.e. the pad at a given row and
+// column is (row * 10) + column, counting from the bottom left.  Each
+// generation translates this into its own layout when painting.
+#define LAUNCHPAD_GRID_SIZE 10
+#define LAUNCHPAD_GRID_CELLS (LAUNCHPAD_GRID_SIZE * LAUNCHPAD_GRID_SIZE)
+
+// Colours are RGB, with 0-127 for each channel, which is what the MK3 uses.
+// Each generation converts these to whatever it can display.
+struct led_colour {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+};
+
+#define LED_COLOUR_BLACK ((struct led_colour) { 0, 0, 0 })
+#define LED_COLOUR_WHITE ((struct led_colour) { 127, 127, 127 })
+
+static inline bool led_colour_equals(struct led_colour a, struct led_colour b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+static inline int led_index(int row, int col) {
+    return (row * LAUNCHPAD_GRID_SIZE) + col;
+}
+
+// One colour per pad, indexed using led_index.
+struct led_frame {
+    struct led_colour cells[LAUNCHPAD_GRID_CELLS];
+
+    // Pads that devices should flash or pulse by themselves, as one of the
+    // LAUNCHPAD_EFFECT_* values, and the palette colour to use, see
+    // animation.h.  Devices that can't run the effect show the colour in cells
+    // instead, which the firmware changes from frame to frame.
+    uint8_t effects[LAUNCHPAD_GRID_CELLS];
+    uint8_t effect_colours[LAUNCHPAD_GRID_CELLS];
+
+    // When the oldest input this frame responds to arrived, or when the frame
+    // was drawn if it isn't a response to input.  Used to measure latency.
+    uint32_t input_time;
+};
+
+// A copy of what we last sent to a single device, so that we only need to
+// send the pads that have changed.  Until we've painted a device at least once
+// we don't know what it looks like, and have to paint everything.
+struct led_shadow {
+    struct led_frame frame;
+    bool is_valid;
+
+    // See led_frame_hash.
+    uint32_t frame_hash;
+
+    // Which of its two buffers a double buffered MK1 is showing.
+    uint8_t displayed_buffer;
+};
+
+// Draw each MK1 frame in the hidden buffer and flip to it once the frame is
+// complete, rather than updating the visible pads as we go.
+#ifndef MK1_DOUBLE_BUFFERED
+#define MK1_DOUBLE_BUFFERED 1
+#endif
+
+// The ways the MK3 can light a single pad, see encode_mk3_colour_specs.
+enum Mk3LightingType {
+  MK3_LIGHTING_STATIC = 0,
+  MK3_LIGHTING_FLASHING = 1,
+  MK3_LIGHTING_PULSING = 2,
+  MK3_LIGHTING_RGB = 3
+};
+
+// The lighting data is one palette colour for static and pulsing pads, two
+// palette colours (B and A) for flashing pads, and red, green and blue for RGB.
+struct mk3_colour_spec {
+    uint8_t lighting_type;
+    uint8_t led_index;
+    uint8_t data[3];
+};
+
+// The most MIDI devices we can have on the host port at once, which should
+// match CFG_TUH_MIDI in tusb_config.h.
+#define MAX_HOST_LAUNCHPADS 4
 
-// Definitions, initially we'll split this up a bit.
-enum LaunchpadVersion {
-  UNkNOWN,
-  MK1,
-  MK2,
-  MK3
+// A Launchpad attached to the host port, either directly or through a hub.
+struct host_device {
+    bool is_mounted;
+    enum LaunchpadModel model;
 };
 
+// Devices are indexed by their TinyUSB MIDI index.
 struct host_state {
-    uint8_t client_idx;
-    enum LaunchpadVersion launchpad_version;
+    struct host_device devices[MAX_HOST_LAUNCHPADS];
 };
 
 struct board_state {
@@ -26,35 +111,57 @@ struct board_state {
     bool is_dirty;
 
     struct host_state host;
+
+    // When the oldest input we haven't painted a response to yet arrived.
+    bool has_pending_input;
+    uint32_t pending_input_time;
 };
 
 void initialise_client_launchpads(void);
 
-void initialise_mk1_client_launchpads(void);
-void initialise_mk2_client_launchpads(void);
-void initialise_mk3_client_launchpads(void);
+enum LaunchpadModel get_client_model(uint8_t);
 
-void paint_client_launchpads(struct board_state*);
+void set_client_model(uint8_t, enum LaunchpadModel);
 
-void paint_mk1_client_launchpads(struct board_state*);
-void paint_mk2_client_launchpads(struct board_state*);
-void paint_mk3_client_launchpads(struct board_state*);
+void render_board_frame(struct board_state*, struct led_frame*);
 
-void paint_host_launchpad(struct board_state*);
+// The layers each frame is built from, see compositor.h.  Anything drawn on
+// them shows up in the next frame.
+struct compositor;
+struct compositor *get_board_compositor(void);
 
-void paint_mk1_host_launchpad(struct board_state*);
-void paint_mk2_host_launchpad(struct board_state*);
-void paint_mk3_host_launchpad(struct board_state*);
+// Pads that animate by themselves, see animation.h.  They're drawn on top of
+// the compositor's layers.
+struct animator;
+struct animator *get_board_animator(void);
 
-void process_incoming_host_packet(uint8_t*, struct board_state*);
+void invalidate_client_shadows(void);
+void invalidate_host_shadow(uint8_t);
 
-void process_incoming_client_packet(uint8_t *, struct board_state*);
+void service_client_launchpads(void);
+bool is_client_output_busy(void);
 
-void process_incoming_mk1_packet (uint8_t*, struct board_state*);
-void process_incoming_mk2_packet (uint8_t*, struct board_state*);
-void process_incoming_mk3_packet (uint8_t*, struct board_state*);
+struct packet_queue_stats get_client_queue_stats(uint8_t);
+struct packet_queue_stats get_host_queue_stats(uint8_t);
 
-enum LaunchpadVersion get_launchpad_version (uint16_t, uint16_t);
+void paint_client_launchpads(const struct led_frame*);
+
+bool write_client_message(uint8_t, const uint8_t*, uint32_t);
+bool write_client_packet(uint8_t, const uint8_t*);
+bool write_host_packet(uint8_t, const uint8_t*);
+bool write_host_message(uint8_t, uint8_t, const uint8_t*, uint32_t);
+
+size_t encode_mk3_colour_specs(uint8_t, const struct mk3_colour_spec*, int, uint8_t*, int*);
+
+void initialise_host_launchpad(uint8_t, enum LaunchpadModel);
+void release_host_launchpad(uint8_t);
+
+void paint_host_launchpads(const struct led_frame*);
+void service_host_launchpads(void);
+
+void process_incoming_host_packet(uint8_t, uint8_t*, struct board_state*);
+
+void process_incoming_client_packet(uint8_t *, struct board_state*);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,197 @@
+#include <stddef.h>
+#include <string.h>
+#include "midi_router.h"
+
+static struct midi_route routes[MIDI_ROUTER_MAX_ROUTES];
+
+static midi_router_writer writers[2];
+static midi_router_message_writer message_writers[2];
+
+void midi_router_init(midi_router_writer client_writer, midi_router_writer host_writer, midi_router_message_writer client_message_writer, midi_router_message_writer host_message_writer) {
+  writers[MIDI_ENDPOINT_CLIENT] = client_writer;
+  writers[MIDI_ENDPOINT_HOST] = host_writer;
+  message_writers[MIDI_ENDPOINT_CLIENT] = client_message_writer;
+  message_writers[MIDI_ENDPOINT_HOST] = host_message_writer;
+  midi_router_clear_routes();
+}
+
+// Returns the slot the route was stored in, which can be passed to
+// midi_router_remove_route, or -1 if the route is invalid or there's no room.
+int midi_router_add_route(const struct midi_route *route) {
+  if (route->destination.type > MIDI_ENDPOINT_HOST || route->destination.index == MIDI_ENDPOINT_ANY || route->source.type > MIDI_ENDPOINT_HOST) {
+    return -1;
+  }
+
+  for (int slot = 0; slot < MIDI_ROUTER_MAX_ROUTES; slot++) {
+    if (!routes[slot].is_enabled) {
+      routes[slot] = *route;
+      routes[slot].is_enabled = true;
+      return slot;
+    }
+  }
+
+  return -1;
+}
+
+void midi_router_remove_route(int slot) {
+  if (slot >= 0 && slot < MIDI_ROUTER_MAX_ROUTES) {
+    routes[slot].is_enabled = false;
+  }
+}
+
+void midi_router_clear_routes(void) {
+  for (int slot = 0; slot < MIDI_ROUTER_MAX_ROUTES; slot++) {
+    routes[slot].is_enabled = false;
+  }
+}
+
+// Code index numbers 8h to Eh are channel messages, with the channel in the low
+// nibble of the status byte.  8h to Ah also have a note in the next byte.
+static inline bool is_channel_message(uint8_t code_index) {
+  return code_index >= 0x8 && code_index <= 0xE;
+}
+
+static inline bool is_note_message(uint8_t code_index) {
+  return code_index >= 0x8 && code_index <= 0xA;
+}
+
+static inline bool is_sysex_code_index(uint8_t code_index) {
+  return code_index >= 0x4 && code_index <= 0x7;
+}
+
+static inline bool source_matches(const struct midi_route *route, struct midi_endpoint source) {
+  return route->source.type == source.type && (route->source.index == MIDI_ENDPOINT_ANY || route->source.index == source.index);
+}
+
+static bool route_matches(const struct midi_route *route, struct midi_endpoint source, const uint8_t *packet) {
+  if (!source_matches(route, source)) {
+    return false;
+  }
+
+  uint8_t code_index = packet[0] & 0x0F;
+  if (route->message_types != 0 && (route->message_types & (1 << code_index)) == 0) {
+    return false;
+  }
+
+  if (is_channel_message(code_index) && route->channels != 0 && (route->channels & (1 << (packet[1] & 0x0F))) == 0) {
+    return false;
+  }
+
+  if (is_note_message(code_index) && route->has_note_range && (packet[2] < route->lowest_note || packet[2] > route->highest_note)) {
+    return false;
+  }
+
+  return true;
+}
+
+// Send a packet from `source` down every route it matches, and return how many
+// routes took it.  A packet that's been remapped is a copy, the original is
+// left alone for the next route.  Sysex packets are ignored, see
+// midi_router_route_sysex.
+uint32_t midi_router_route_packet(struct midi_endpoint source, const uint8_t *packet) {
+  uint32_t forwarded = 0;
+
+  if (is_sysex_code_index(packet[0] & 0x0F)) {
+    return 0;
+  }
+
+  for (int slot = 0; slot < MIDI_ROUTER_MAX_ROUTES; slot++) {
+    const struct midi_route *route = &routes[slot];
+    if (!route->is_enabled || !route_matches(route, source, packet)) {
+      continue;
+    }
+
+    midi_router_writer writer = writers[route->destination.type];
+    if (writer == NULL) {
+      continue;
+    }
+
+    uint8_t code_index = packet[0] & 0x0F;
+    bool is_remapped = (route->channel_map != NULL && is_channel_message(code_index)) || (route->note_map != NULL && is_note_message(code_index));
+
+    if (!is_remapped) {
+      forwarded += writer(route->destination.index, packet) ? 1 : 0;
+      continue;
+    }
+
+    uint8_t remapped_packet[4] = { packet[0], packet[1], packet[2], packet[3] };
+    if (route->channel_map != NULL && is_channel_message(code_index)) {
+      remapped_packet[1] = (packet[1] & 0xF0) | (route->channel_map[packet[1] & 0x0F] & 0x0F);
+    }
+    if (route->note_map != NULL && is_note_message(code_index)) {
+      remapped_packet[2] = route->note_map[packet[2] & 0x7F] & 0x7F;
+    }
+
+    forwarded += writer(route->destination.index, remapped_packet) ? 1 : 0;
+  }
+
+  return forwarded;
+}
+
+// Send a complete sysex message from `source` down every route that takes
+// sysex, and return how many routes took it.
+uint32_t midi_router_route_sysex(struct midi_endpoint source, const uint8_t *message, uint16_t length) {
+  uint32_t forwarded = 0;
+
+  for (int slot = 0; slot < MIDI_ROUTER_MAX_ROUTES; slot++) {
+    const struct midi_route *route = &routes[slot];
+    if (!route->is_enabled || !source_matches(route, source)) {
+      continue;
+    }
+
+    if (route->message_types != 0 && (route->message_types & MIDI_ROUTE_SYSEX) == 0) {
+      continue;
+    }
+
+    midi_router_message_writer writer = message_writers[route->destination.type];
+    if (writer != NULL) {
+      forwarded += writer(route->destination.index, message, length) ? 1 : 0;
+    }
+  }
+
+  return forwarded;
+}
+
+// Copy every route that doesn't remap anything into `configs`, which must have
+// room for MIDI_ROUTER_MAX_ROUTES, and return how many there were.
+uint8_t midi_router_save_routes(struct midi_route_config *configs) {
+  uint8_t count = 0;
+
+  for (int slot = 0; slot < MIDI_ROUTER_MAX_ROUTES; slot++) {
+    const struct midi_route *route = &routes[slot];
+    if (!route->is_enabled || route->note_map != NULL || route->channel_map != NULL) {
+      continue;
+    }
+
+    struct midi_route_config *config = &configs[count++];
+    memset(config, 0, sizeof(*config));
+    config->source = route->source;
+    config->destination = route->destination;
+    config->message_types = route->message_types;
+    config->channels = route->channels;
+    config->has_note_range = route->has_note_range;
+    config->lowest_note = route->lowest_note;
+    config->highest_note = route->highest_note;
+  }
+
+  return count;
+}
+
+// Replace every route with the ones we saved.
+void midi_router_restore_routes(const struct midi_route_config *configs, uint8_t count) {
+  midi_router_clear_routes();
+
+  for (uint8_t index = 0; index < count && index < MIDI_ROUTER_MAX_ROUTES; index++) {
+    const struct midi_route_config *config = &configs[index];
+    struct midi_route route = {
+      .source = config->source,
+      .destination = config->destination,
+      .message_types = config->message_types,
+      .channels = config->channels,
+      .has_note_range = config->has_note_range,
+      .lowest_note = config->lowest_note,
+      .highest_note = config->highest_note
+    };
+    midi_router_add_route(&route);
+  }
+}
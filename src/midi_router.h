@@ -0,0 +1,118 @@
+#ifndef _MIDI_ROUTER_H_
+#define _MIDI_ROUTER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Forwards MIDI between our client cables and the devices on the host port.
+// Each route picks out some of the packets from one source, optionally changes
+// their note or channel, and sends them to one destination.  Packets are
+// forwarded as the same 4 byte USB MIDI events they arrived as, we only ever
+// change the cable, channel and note in place.
+//
+// Sysex is the exception.  Its packets are never forwarded one at a time, as
+// they could end up in the middle of another message on the way out.  Instead,
+// each complete message from sysex_assembler is passed to
+// midi_router_route_sysex, and forwarded whole.
+
+enum MidiEndpointType {
+  MIDI_ENDPOINT_CLIENT,
+  MIDI_ENDPOINT_HOST
+};
+
+// For a source, matches every client cable or every host device.
+#define MIDI_ENDPOINT_ANY 0xFF
+
+struct midi_endpoint {
+    uint8_t type;
+
+    // The client cable, or the index of the host device.
+    uint8_t index;
+};
+
+// The message types a route can pick out, one bit per code index number (the
+// low nibble of the first byte of a USB MIDI packet).
+#define MIDI_ROUTE_SYSEX            ((1 << 0x4) | (1 << 0x5) | (1 << 0x6) | (1 << 0x7))
+#define MIDI_ROUTE_NOTE_OFF         (1 << 0x8)
+#define MIDI_ROUTE_NOTE_ON          (1 << 0x9)
+#define MIDI_ROUTE_POLY_PRESSURE    (1 << 0xA)
+#define MIDI_ROUTE_CONTROL_CHANGE   (1 << 0xB)
+#define MIDI_ROUTE_PROGRAM_CHANGE   (1 << 0xC)
+#define MIDI_ROUTE_CHANNEL_PRESSURE (1 << 0xD)
+#define MIDI_ROUTE_PITCH_BEND       (1 << 0xE)
+#define MIDI_ROUTE_NOTES            (MIDI_ROUTE_NOTE_OFF | MIDI_ROUTE_NOTE_ON | MIDI_ROUTE_POLY_PRESSURE)
+
+struct midi_route {
+    bool is_enabled;
+
+    struct midi_endpoint source;
+
+    // Must be a single cable or device, not MIDI_ENDPOINT_ANY.
+    struct midi_endpoint destination;
+
+    // The MIDI_ROUTE_* types to forward, or 0 for everything.
+    uint16_t message_types;
+
+    // One bit per channel (bit 0 is channel 1), or 0 for every channel.  Only
+    // applies to channel messages, sysex and the like always pass.
+    uint16_t channels;
+
+    // Only forward note messages between these notes, inclusive.
+    bool has_note_range;
+    uint8_t lowest_note;
+    uint8_t highest_note;
+
+    // If set, the note to send for each incoming note (128 entries) and the
+    // channel to send for each incoming channel (16 entries, counting from 0).
+    const uint8_t *note_map;
+    const uint8_t *channel_map;
+};
+
+#define MIDI_ROUTER_MAX_ROUTES 16
+
+// The parts of a route that can be saved, see persistent_store.h.  The
+// remapping tables live in the firmware, so routes that use them have to be
+// added again by the code that owns the tables.
+struct midi_route_config {
+    struct midi_endpoint source;
+    struct midi_endpoint destination;
+    uint16_t message_types;
+    uint16_t channels;
+    bool has_note_range;
+    uint8_t lowest_note;
+    uint8_t highest_note;
+};
+
+// What the router calls to send a packet on to a client cable or host device.
+// The writer is responsible for setting the cable number in the packet.
+typedef bool (*midi_router_writer)(uint8_t index, const uint8_t *packet);
+
+// The same for a whole sysex message, from F0h to F7h, which the writer must
+// queue in one piece or not at all.
+typedef bool (*midi_router_message_writer)(uint8_t index, const uint8_t *message, uint16_t length);
+
+void midi_router_init(midi_router_writer client_writer, midi_router_writer host_writer, midi_router_message_writer client_message_writer, midi_router_message_writer host_message_writer);
+
+int midi_router_add_route(const struct midi_route*);
+
+void midi_router_remove_route(int);
+
+void midi_router_clear_routes(void);
+
+uint32_t midi_router_route_packet(struct midi_endpoint, const uint8_t*);
+
+uint32_t midi_router_route_sysex(struct midi_endpoint, const uint8_t*, uint16_t);
+
+uint8_t midi_router_save_routes(struct midi_route_config*);
+
+void midi_router_restore_routes(const struct midi_route_config*, uint8_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MIDI_ROUTER_H_ */
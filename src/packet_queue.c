@@ -0,0 +1,296 @@
+#include <string.h>
+#include "packet_queue.h"
+
+// The "code index numbers" from the USB MIDI spec that we need to frame
+// messages ourselves.
+#define CIN_SYSCOM_2BYTE 0x2
+#define CIN_SYSCOM_3BYTE 0x3
+#define CIN_SYSEX_END_1BYTE 0x5
+#define CIN_1BYTE_DATA 0xF
+
+// How many bytes make up the message starting with a given status byte.  Sysex
+// is handled separately, as it's as long as it needs to be.
+static uint32_t message_length(uint8_t status) {
+  switch (status & 0xF0) {
+    case 0xC0:
+    case 0xD0:
+      return 2;
+    case 0xF0:
+      if (status == 0xF1 || status == 0xF3) {
+        return 2;
+      }
+      else if (status == 0xF2) {
+        return 3;
+      }
+      return 1;
+    default:
+      return 3;
+  }
+}
+
+static uint8_t message_code_index(uint8_t status, uint32_t length) {
+  if (status < 0xF0) {
+    return status >> 4;
+  }
+  else if (length == 3) {
+    return CIN_SYSCOM_3BYTE;
+  }
+  else if (length == 2) {
+    return CIN_SYSCOM_2BYTE;
+  }
+  else if (status == 0xF6) {
+    return CIN_SYSEX_END_1BYTE;
+  }
+  return CIN_1BYTE_DATA;
+}
+
+// Walk through the messages in a buffer, calling `on_packet` with each USB MIDI
+// packet in turn.  Sysex goes three bytes at a time, using CIN 4 for the start
+// and middle of the message, and CIN 5, 6 or 7 for the last one, two or three
+// bytes.
+static uint32_t frame_messages(uint8_t cable, const uint8_t *bytes, uint32_t length, void (*on_packet)(void*, const uint8_t*), void *context) {
+  uint32_t packet_count = 0;
+  uint32_t offset = 0;
+
+  while (offset < length) {
+    uint8_t packet[USB_MIDI_PACKET_SIZE] = { 0, 0, 0, 0 };
+    uint32_t chunk_length;
+
+    if (bytes[offset] == 0xF0) {
+      uint32_t sysex_end = offset;
+      while (sysex_end < length - 1 && bytes[sysex_end] != 0xF7) {
+        sysex_end++;
+      }
+
+      while (offset <= sysex_end) {
+        uint32_t remaining = sysex_end + 1 - offset;
+        chunk_length = remaining > 3 ? 3 : remaining;
+
+        packet[0] = (cable << 4) | (remaining > 3 ? USB_MIDI_CIN_SYSEX_START : CIN_SYSEX_END_1BYTE + (chunk_length - 1));
+        memset(packet + 1, 0, 3);
+        memcpy(packet + 1, bytes + offset, chunk_length);
+
+        if (on_packet) {
+          on_packet(context, packet);
+        }
+        packet_count++;
+        offset += chunk_length;
+      }
+    }
+    else {
+      uint8_t status = bytes[offset];
+      chunk_length = message_length(status);
+      if (chunk_length > length - offset) {
+        chunk_length = length - offset;
+      }
+
+      packet[0] = (cable << 4) | message_code_index(status, chunk_length);
+      memcpy(packet + 1, bytes + offset, chunk_length);
+
+      if (on_packet) {
+        on_packet(context, packet);
+      }
+      packet_count++;
+      offset += chunk_length;
+    }
+  }
+
+  return packet_count;
+}
+
+void packet_queue_clear(struct packet_queue *queue) {
+  queue->dropped_packets += queue->count;
+  queue->head = 0;
+  queue->count = 0;
+  queue->popped_packets = queue->pushed_packets;
+  queue->is_frame_pending = false;
+}
+
+uint16_t packet_queue_free(const struct packet_queue *queue) {
+  return PACKET_QUEUE_LENGTH - queue->count;
+}
+
+// How many USB MIDI packets it takes to send a buffer of MIDI messages.
+uint32_t usb_midi_packet_count(const uint8_t *bytes, uint32_t length) {
+  return frame_messages(0, bytes, length, NULL, NULL);
+}
+
+struct packet_buffer {
+    uint8_t *packets;
+    uint32_t count;
+};
+
+static void append_packet(void *context, const uint8_t *packet) {
+  struct packet_buffer *buffer = (struct packet_buffer *) context;
+  memcpy(buffer->packets + (buffer->count * USB_MIDI_PACKET_SIZE), packet, USB_MIDI_PACKET_SIZE);
+  buffer->count++;
+}
+
+// Turn a buffer of MIDI messages into USB MIDI packets, e.g. to pass them to
+// another core.  `packets` needs room for usb_midi_packet_count packets.
+uint32_t usb_midi_frame_messages(uint8_t cable, const uint8_t *bytes, uint32_t length, uint8_t *packets) {
+  struct packet_buffer buffer = { packets, 0 };
+  frame_messages(cable, bytes, length, append_packet, &buffer);
+  return buffer.count;
+}
+
+static void push_packet(void *context, const uint8_t *packet) {
+  struct packet_queue *queue = (struct packet_queue *) context;
+  uint16_t tail = (queue->head + queue->count) & (PACKET_QUEUE_LENGTH - 1);
+  memcpy(queue->packets[tail], packet, USB_MIDI_PACKET_SIZE);
+  queue->count++;
+  queue->pushed_packets++;
+}
+
+// Queue a buffer of MIDI messages on a cable.  We either queue all of it or
+// none of it, so a device never sees half a message.
+bool packet_queue_push_message(struct packet_queue *queue, uint8_t cable, const uint8_t *bytes, uint32_t length) {
+  if (usb_midi_packet_count(bytes, length) > packet_queue_free(queue)) {
+    queue->dropped_messages++;
+    return false;
+  }
+
+  frame_messages(cable, bytes, length, push_packet, queue);
+
+  if (queue->count > queue->high_water_mark) {
+    queue->high_water_mark = queue->count;
+  }
+
+  return true;
+}
+
+// Queue a packet that's already been framed, e.g. one we're forwarding from
+// another device.
+bool packet_queue_push_packet(struct packet_queue *queue, const uint8_t *packet) {
+  if (packet_queue_free(queue) == 0) {
+    queue->dropped_messages++;
+    return false;
+  }
+
+  push_packet(queue, packet);
+
+  if (queue->count > queue->high_water_mark) {
+    queue->high_water_mark = queue->count;
+  }
+
+  return true;
+}
+
+// Queue a run of packets that have already been framed, e.g. a frame we
+// encoded earlier.  Like messages, we queue all of them or none of them.
+bool packet_queue_push_packets(struct packet_queue *queue, const uint8_t *packets, uint16_t packet_count) {
+  if (packet_count > packet_queue_free(queue)) {
+    queue->dropped_messages++;
+    return false;
+  }
+
+  // The free space may wrap round the end of the ring.
+  uint16_t tail = (queue->head + queue->count) & (PACKET_QUEUE_LENGTH - 1);
+  uint16_t first_run = PACKET_QUEUE_LENGTH - tail < packet_count ? PACKET_QUEUE_LENGTH - tail : packet_count;
+  memcpy(queue->packets[tail], packets, first_run * USB_MIDI_PACKET_SIZE);
+  memcpy(queue->packets[0], packets + (first_run * USB_MIDI_PACKET_SIZE), (packet_count - first_run) * USB_MIDI_PACKET_SIZE);
+
+  queue->count += packet_count;
+  queue->pushed_packets += packet_count;
+
+  if (queue->count > queue->high_water_mark) {
+    queue->high_water_mark = queue->count;
+  }
+
+  return true;
+}
+
+// Copy the `packet_count` packets that were queued most recently, which must
+// all still be waiting.
+void packet_queue_copy_newest(const struct packet_queue *queue, uint8_t *buffer, uint16_t packet_count) {
+  for (uint16_t packet_index = 0; packet_index < packet_count; packet_index++) {
+    uint16_t queue_index = (queue->head + queue->count - packet_count + packet_index) & (PACKET_QUEUE_LENGTH - 1);
+    memcpy(buffer + (packet_index * USB_MIDI_PACKET_SIZE), queue->packets[queue_index], USB_MIDI_PACKET_SIZE);
+  }
+}
+
+// Copy up to `max_packets` packets from the front of the queue, without
+// removing them.  Returns the number of packets copied.
+uint16_t packet_queue_peek(const struct packet_queue *queue, uint8_t *buffer, uint16_t max_packets) {
+  uint16_t packet_count = queue->count < max_packets ? queue->count : max_packets;
+
+  for (uint16_t packet_index = 0; packet_index < packet_count; packet_index++) {
+    uint16_t queue_index = (queue->head + packet_index) & (PACKET_QUEUE_LENGTH - 1);
+    memcpy(buffer + (packet_index * USB_MIDI_PACKET_SIZE), queue->packets[queue_index], USB_MIDI_PACKET_SIZE);
+  }
+
+  return packet_count;
+}
+
+void packet_queue_pop(struct packet_queue *queue, uint16_t packet_count) {
+  if (packet_count > queue->count) {
+    packet_count = queue->count;
+  }
+
+  queue->head = (queue->head + packet_count) & (PACKET_QUEUE_LENGTH - 1);
+  queue->count -= packet_count;
+  queue->popped_packets += packet_count;
+}
+
+// The upper limit of each latency bucket but the last, in microseconds.
+static const uint32_t latency_bucket_limits[PACKET_QUEUE_LATENCY_BUCKETS - 1] = {
+  500, 1000, 2000, 4000, 8000, 16000, 32000
+};
+
+// Call this once everything for a frame has been queued, with the time the
+// frame started, e.g. when the input that led to it arrived.
+void packet_queue_mark_frame(struct packet_queue *queue, uint32_t start_time) {
+  // Nothing was queued for this frame, so there's nothing to time.
+  if (queue->pushed_packets == queue->frame_end_packet) {
+    return;
+  }
+
+  if (!queue->is_frame_pending) {
+    queue->is_frame_pending = true;
+    queue->frame_start_time = start_time;
+  }
+
+  queue->frame_end_packet = queue->pushed_packets;
+}
+
+// Call this after sending packets, to see whether we've finished a frame.
+void packet_queue_check_frame_sent(struct packet_queue *queue, uint32_t now) {
+  if (!queue->is_frame_pending || (int32_t) (queue->popped_packets - queue->frame_end_packet) < 0) {
+    return;
+  }
+
+  uint32_t latency = now - queue->frame_start_time;
+
+  queue->is_frame_pending = false;
+  queue->frames_sent++;
+  queue->last_frame_latency = latency;
+  queue->total_frame_latency += latency;
+  if (latency > queue->max_frame_latency) {
+    queue->max_frame_latency = latency;
+  }
+
+  int bucket = 0;
+  while (bucket < PACKET_QUEUE_LATENCY_BUCKETS - 1 && latency >= latency_bucket_limits[bucket]) {
+    bucket++;
+  }
+  queue->latency_histogram[bucket]++;
+}
+
+struct packet_queue_stats packet_queue_get_stats(const struct packet_queue *queue) {
+  struct packet_queue_stats stats = {
+    queue->count,
+    queue->high_water_mark,
+    queue->dropped_messages,
+    queue->dropped_packets,
+    queue->frames_sent,
+    (queue->popped_packets - queue->dropped_packets) * USB_MIDI_PACKET_SIZE,
+    queue->last_frame_latency,
+    queue->max_frame_latency,
+    queue->frames_sent > 0 ? (uint32_t) (queue->total_frame_latency / queue->frames_sent) : 0,
+    { 0 }
+  };
+
+  memcpy(stats.latency_histogram, queue->latency_histogram, sizeof(stats.latency_histogram));
+
+  return stats;
+}
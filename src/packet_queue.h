@@ -0,0 +1,109 @@
+#ifndef _PACKET_QUEUE_H_
+#define _PACKET_QUEUE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// USB MIDI sends everything as four byte packets (a header byte with the cable
+// and "code index number", followed by up to three MIDI bytes).  We queue
+// outgoing messages as packets, so that we can hand them to TinyUSB as space
+// becomes available without ever splitting a message in the middle of a byte.
+
+// The number of packets each queue can hold, enough for the largest frame we
+// send (an MK3 frame with every pad set to an RGB colour).  Must be a power of
+// two.
+#define PACKET_QUEUE_LENGTH 256
+
+#define USB_MIDI_PACKET_SIZE 4
+
+// Frame latencies are counted in buckets of under 0.5, 1, 2, 4, 8, 16 and
+// 32 ms, and 32 ms or more.
+#define PACKET_QUEUE_LATENCY_BUCKETS 8
+
+struct packet_queue {
+    uint8_t packets[PACKET_QUEUE_LENGTH][USB_MIDI_PACKET_SIZE];
+    uint16_t head;
+    uint16_t count;
+
+    // The most packets that have been waiting at once.
+    uint16_t high_water_mark;
+
+    // Messages we had to throw away because they didn't fit.
+    uint32_t dropped_messages;
+
+    // Running totals, used to tell when everything in a frame has been sent.
+    // Packets thrown away by packet_queue_clear count as popped, and are also
+    // counted in dropped_packets, so that they aren't reported as sent.
+    uint32_t pushed_packets;
+    uint32_t popped_packets;
+    uint32_t dropped_packets;
+
+    // The oldest frame that hasn't been sent in full yet, if any.  When frames
+    // pile up, we time from the first one until the queue catches up.
+    bool is_frame_pending;
+    uint32_t frame_start_time;
+    uint32_t frame_end_packet;
+
+    // How long it takes from a frame starting until its last packet is handed
+    // to TinyUSB, in microseconds.
+    uint32_t frames_sent;
+    uint32_t last_frame_latency;
+    uint32_t max_frame_latency;
+    uint64_t total_frame_latency;
+    uint32_t latency_histogram[PACKET_QUEUE_LATENCY_BUCKETS];
+};
+
+// A snapshot of a queue's counters.
+struct packet_queue_stats {
+    uint16_t queued_packets;
+    uint16_t high_water_mark;
+    uint32_t dropped_messages;
+    uint32_t dropped_packets;
+
+    uint32_t frames_sent;
+    uint32_t bytes_sent;
+    uint32_t last_frame_latency;
+    uint32_t max_frame_latency;
+    uint32_t mean_frame_latency;
+    uint32_t latency_histogram[PACKET_QUEUE_LATENCY_BUCKETS];
+};
+
+// The "code index number" USB MIDI uses for the start and middle of a sysex
+// message, which is the only time a message spans more than one packet.
+#define USB_MIDI_CIN_SYSEX_START 0x4
+
+void packet_queue_clear(struct packet_queue*);
+
+uint16_t packet_queue_free(const struct packet_queue*);
+
+uint32_t usb_midi_packet_count(const uint8_t*, uint32_t);
+
+uint32_t usb_midi_frame_messages(uint8_t, const uint8_t*, uint32_t, uint8_t*);
+
+bool packet_queue_push_message(struct packet_queue*, uint8_t, const uint8_t*, uint32_t);
+
+bool packet_queue_push_packet(struct packet_queue*, const uint8_t*);
+
+bool packet_queue_push_packets(struct packet_queue*, const uint8_t*, uint16_t);
+
+void packet_queue_copy_newest(const struct packet_queue*, uint8_t*, uint16_t);
+
+uint16_t packet_queue_peek(const struct packet_queue*, uint8_t*, uint16_t);
+
+void packet_queue_pop(struct packet_queue*, uint16_t);
+
+void packet_queue_mark_frame(struct packet_queue*, uint32_t);
+
+void packet_queue_check_frame_sent(struct packet_queue*, uint32_t);
+
+struct packet_queue_stats packet_queue_get_stats(const struct packet_queue*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PACKET_QUEUE_H_ */
@@ -0,0 +1,79 @@
+#include "pad_layout.h"
+
+// Expand a macro once for each index in a range, so that the compiler fills in
+// every entry of a table from a single formula.
+#define REPEAT_10(f, n) f(n), f(n + 1), f(n + 2), f(n + 3), f(n + 4), f(n + 5), f(n + 6), f(n + 7), f(n + 8), f(n + 9)
+#define REPEAT_100(f) \
+  REPEAT_10(f, 0), REPEAT_10(f, 10), REPEAT_10(f, 20), REPEAT_10(f, 30), REPEAT_10(f, 40), \
+  REPEAT_10(f, 50), REPEAT_10(f, 60), REPEAT_10(f, 70), REPEAT_10(f, 80), REPEAT_10(f, 90)
+#define REPEAT_128(f) REPEAT_100(f), REPEAT_10(f, 100), REPEAT_10(f, 110), f(120), f(121), f(122), f(123), f(124), f(125), f(126), f(127)
+
+#define CELL_ROW(index) ((index) / LAUNCHPAD_GRID_SIZE)
+#define CELL_COLUMN(index) ((index) % LAUNCHPAD_GRID_SIZE)
+
+const uint8_t grid_cell_rows[LAUNCHPAD_GRID_CELLS] = { REPEAT_100(CELL_ROW) };
+const uint8_t grid_cell_columns[LAUNCHPAD_GRID_CELLS] = { REPEAT_100(CELL_COLUMN) };
+
+// The MK1 "X-Y" layout numbers pads (row * 16) + column, counting from the top
+// left, where we count from the bottom left and shift everything over by one
+// column and up by one row, see paint_mk1.  The scene buttons on the right are
+// part of the same numbering, the automap buttons along the top are
+// controllers 104-111.
+#define XY_IS_NOTE_CELL(index) (CELL_ROW(index) >= 1 && CELL_ROW(index) <= 8 && CELL_COLUMN(index) >= 1)
+#define XY_IS_CONTROL_CELL(index) (CELL_ROW(index) == 9 && CELL_COLUMN(index) >= 1 && CELL_COLUMN(index) <= 8)
+
+#define XY_PAD_FOR_CELL(index) { \
+  XY_IS_NOTE_CELL(index) ? 0x90 : XY_IS_CONTROL_CELL(index) ? 0xB0 : 0, \
+  XY_IS_NOTE_CELL(index) ? ((8 - CELL_ROW(index)) * 16) + (CELL_COLUMN(index) - 1) : XY_IS_CONTROL_CELL(index) ? 103 + CELL_COLUMN(index) : 0 \
+}
+
+#define XY_CELL_FOR_NOTE(note) \
+  ((note) % 16 <= 8 && (note) / 16 <= 7 ? ((8 - (note) / 16) * LAUNCHPAD_GRID_SIZE) + ((note) % 16) + 1 : PAD_LAYOUT_NO_CELL)
+
+static const struct pad_address xy_pads[LAUNCHPAD_GRID_CELLS] = { REPEAT_100(XY_PAD_FOR_CELL) };
+static const int8_t xy_cells[128] = { REPEAT_128(XY_CELL_FOR_NOTE) };
+
+// The "programmer" layout uses our own numbering.  The square pads are notes,
+// and the buttons around them are controllers.  There is nothing in the
+// corners apart from the side light at 99.
+#define PROGRAMMER_IS_CORNER(index) ((index) == 0 || (index) == 9 || (index) == 90)
+#define PROGRAMMER_IS_NOTE_CELL(index) (CELL_ROW(index) >= 1 && CELL_ROW(index) <= 8 && CELL_COLUMN(index) >= 1 && CELL_COLUMN(index) <= 8)
+
+#define PROGRAMMER_PAD_FOR_CELL(index) { \
+  PROGRAMMER_IS_CORNER(index) ? 0 : PROGRAMMER_IS_NOTE_CELL(index) ? 0x90 : 0xB0, \
+  PROGRAMMER_IS_CORNER(index) ? 0 : (index) \
+}
+
+#define PROGRAMMER_CELL_FOR_NOTE(note) (PROGRAMMER_IS_NOTE_CELL(note) ? (note) : PAD_LAYOUT_NO_CELL)
+
+static const struct pad_address programmer_pads[LAUNCHPAD_GRID_CELLS] = { REPEAT_100(PROGRAMMER_PAD_FOR_CELL) };
+static const int8_t programmer_cells[128] = { REPEAT_128(PROGRAMMER_CELL_FOR_NOTE) };
+
+static const struct pad_layout pad_layouts[] = {
+  [LAUNCHPAD_LAYOUT_XY] = { xy_pads, xy_cells },
+  [LAUNCHPAD_LAYOUT_PROGRAMMER] = { programmer_pads, programmer_cells }
+};
+
+const struct pad_layout *get_pad_layout(enum LaunchpadNoteLayout layout) {
+  return &pad_layouts[layout];
+}
+
+// The MK1 rapid update mode starts at the top left of the square pads and
+// works along each row and down, then does the scene buttons from the top
+// down, then the automap buttons from left to right.
+#define GRID_ROW_1_TO_8(row) \
+  ((row) * 10) + 1, ((row) * 10) + 2, ((row) * 10) + 3, ((row) * 10) + 4, \
+  ((row) * 10) + 5, ((row) * 10) + 6, ((row) * 10) + 7, ((row) * 10) + 8
+
+const uint8_t mk1_rapid_update_cells[MK1_RAPID_UPDATE_CELLS] = {
+  GRID_ROW_1_TO_8(8), GRID_ROW_1_TO_8(7), GRID_ROW_1_TO_8(6), GRID_ROW_1_TO_8(5),
+  GRID_ROW_1_TO_8(4), GRID_ROW_1_TO_8(3), GRID_ROW_1_TO_8(2), GRID_ROW_1_TO_8(1),
+  89, 79, 69, 59, 49, 39, 29, 19,
+  GRID_ROW_1_TO_8(9)
+};
+
+// The MK2 fills its grid from the bottom left, one row at a time, like us.
+const uint8_t grid_centre_cells[GRID_CENTRE_CELLS] = {
+  GRID_ROW_1_TO_8(1), GRID_ROW_1_TO_8(2), GRID_ROW_1_TO_8(3), GRID_ROW_1_TO_8(4),
+  GRID_ROW_1_TO_8(5), GRID_ROW_1_TO_8(6), GRID_ROW_1_TO_8(7), GRID_ROW_1_TO_8(8)
+};
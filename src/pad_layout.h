@@ -0,0 +1,59 @@
+#ifndef _PAD_LAYOUT_H_
+#define _PAD_LAYOUT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device_profile.h"
+#include "launchpad.h"
+
+// Lookup tables that translate between our grid and the notes and controllers
+// each layout uses, in both directions.  The tables are filled in by the
+// compiler (see pad_layout.c), so nothing is worked out at runtime.
+
+// The row and column of each cell in our grid.
+extern const uint8_t grid_cell_rows[LAUNCHPAD_GRID_CELLS];
+extern const uint8_t grid_cell_columns[LAUNCHPAD_GRID_CELLS];
+
+// The message that lights a single pad: a note on or control change on
+// channel 1, with the colour as the velocity or value.  A status of zero
+// means there's no pad at that position.
+struct pad_address {
+    uint8_t status;
+    uint8_t number;
+};
+
+#define PAD_LAYOUT_NO_CELL -1
+
+struct pad_layout {
+    // Indexed by grid cell.
+    const struct pad_address *pad_for_cell;
+
+    // Indexed by note number, the cell for the pad, or PAD_LAYOUT_NO_CELL.
+    const int8_t *cell_for_note;
+};
+
+const struct pad_layout *get_pad_layout(enum LaunchpadNoteLayout);
+
+// The order the MK1 "rapid update" mode fills pads in, two per message.
+#define MK1_RAPID_UPDATE_CELLS 80
+extern const uint8_t mk1_rapid_update_cells[MK1_RAPID_UPDATE_CELLS];
+
+// The cells of the central 8 x 8 square, in the order the MK2 "grid" message
+// expects them.
+#define GRID_CENTRE_CELLS 64
+extern const uint8_t grid_centre_cells[GRID_CENTRE_CELLS];
+
+static inline bool is_centre_cell(int index) {
+    return grid_cell_rows[index] >= 1 && grid_cell_rows[index] <= 8 && grid_cell_columns[index] >= 1 && grid_cell_columns[index] <= 8;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PAD_LAYOUT_H_ */
@@ -0,0 +1,43 @@
+#include "palette.h"
+
+// Approximate RGB values for the 128 colour palette shared by the MK2 and MK3,
+// scaled to 0-127 per channel.  These were measured by eye and by the community
+// rather than taken from Novation's documentation, so they're close enough to
+// pick a sensible palette entry, but not exact.
+//
+// The lookup tables in palette.h are generated from this table when the
+// firmware is built, so keep it in the same format.
+const struct led_colour novation_palette[PALETTE_SIZE] = {
+  {   0,   0,   0 }, {  15,  15,  15 }, {  63,  63,  63 }, { 127, 127, 127 },  // 0-3
+  { 127,  38,  38 }, { 127,   0,   0 }, {  44,   0,   0 }, {  12,   0,   0 },  // 4-7
+  { 127,  94,  54 }, { 127,  42,   0 }, {  44,  14,   0 }, {  19,  13,   0 },  // 8-11
+  { 127, 127,  38 }, { 127, 127,   0 }, {  44,  44,   0 }, {  12,  12,   0 },  // 12-15
+  {  68, 127,  38 }, {  42, 127,   0 }, {  14,  44,   0 }, {  10,  21,   0 },  // 16-19
+  {  38, 127,  38 }, {   0, 127,   0 }, {   0,  44,   0 }, {   0,  12,   0 },  // 20-23
+  {  38, 127,  47 }, {   0, 127,  12 }, {   0,  44,   6 }, {   0,  12,   1 },  // 24-27
+  {  38, 127,  68 }, {   0, 127,  42 }, {   0,  44,  14 }, {   0,  15,   9 },  // 28-31
+  {  38, 127,  91 }, {   0, 127,  76 }, {   0,  44,  26 }, {   0,  12,   9 },  // 32-35
+  {  38,  97, 127 }, {   0,  84, 127 }, {   0,  32,  41 }, {   0,   8,  12 },  // 36-39
+  {  38,  68, 127 }, {   0,  42, 127 }, {   0,  14,  44 }, {   0,   4,  12 },  // 40-43
+  {  38,  38, 127 }, {   0,   0, 127 }, {   0,   0,  44 }, {   0,   0,  12 },  // 44-47
+  {  67,  38, 127 }, {  42,   0, 127 }, {  12,   0,  50 }, {   7,   0,  24 },  // 48-51
+  { 127,  38, 127 }, { 127,   0, 127 }, {  44,   0,  44 }, {  12,   0,  12 },  // 52-55
+  { 127,  38,  67 }, { 127,   0,  42 }, {  44,   0,  14 }, {  17,   0,   9 },  // 56-59
+  { 127,  10,   0 }, {  76,  26,   0 }, {  60,  40,   0 }, {  33,  50,   0 },  // 60-63
+  {   1,  28,   0 }, {   0,  43,  26 }, {   0,  42,  63 }, {   0,   0, 127 },  // 64-67
+  {   0,  34,  39 }, {  18,   0, 102 }, {  63,  63,  63 }, {  16,  16,  16 },  // 68-71
+  { 127,   0,   0 }, {  94, 127,  22 }, {  87, 118,   3 }, {  50, 127,   4 },  // 72-75
+  {   8,  69,   0 }, {   0, 127,  67 }, {   0,  84, 127 }, {   0,  21, 127 },  // 76-79
+  {  31,   0, 127 }, {  61,   0, 127 }, {  89,  13,  62 }, {  32,  16,   0 },  // 80-83
+  { 127,  37,   0 }, {  68, 112,   3 }, {  57, 127,  10 }, {   0, 127,   0 },  // 84-87
+  {  29, 127,  19 }, {  44, 127,  56 }, {  28, 127, 102 }, {  45,  69, 127 },  // 88-91
+  {  24,  40,  99 }, {  67,  63, 116 }, { 105,  14, 127 }, { 127,   0,  46 },  // 92-95
+  { 127,  63,   0 }, {  92,  88,   0 }, {  72, 127,   0 }, {  65,  46,   3 },  // 96-99
+  {  28,  21,   0 }, {  10,  38,   8 }, {   6,  40,  28 }, {  10,  10,  21 },  // 100-103
+  {  11,  16,  45 }, {  52,  30,  14 }, {  84,   0,   5 }, { 111,  40,  30 },  // 104-107
+  { 108,  53,  14 }, { 127, 112,  19 }, {  79, 112,  23 }, {  51,  90,   7 },  // 108-111
+  {  15,  15,  24 }, { 110, 127,  53 }, {  64, 127,  94 }, {  77,  76, 127 },  // 112-115
+  {  71,  51, 127 }, {  32,  32,  32 }, {  58,  58,  58 }, { 112, 127, 127 },  // 116-119
+  {  80,   0,   0 }, {  26,   0,   0 }, {  13, 104,   0 }, {   3,  33,   0 },  // 120-123
+  {  92,  88,   0 }, {  31,  24,   0 }, {  89,  47,   0 }, {  37,  10,   1 },  // 124-127
+};
@@ -0,0 +1,70 @@
+#ifndef _PALETTE_H_
+#define _PALETTE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "launchpad.h"
+
+#define PALETTE_SIZE 128
+
+extern const struct led_colour novation_palette[PALETTE_SIZE];
+
+// Everything is drawn in RGB, and converted to what each device can show with
+// lookup tables that are worked out when the firmware is built (see
+// tools/generate_palette_tables.py), so there's no searching at runtime.
+
+// The closest palette entry for each colour, looked up using the top
+// PALETTE_LUT_BITS of each channel.
+#define PALETTE_LUT_BITS 4
+#define PALETTE_LUT_SIZE (1 << (3 * PALETTE_LUT_BITS))
+
+extern const uint8_t palette_lut[PALETTE_LUT_SIZE];
+
+static inline uint8_t palette_index_for_colour(struct led_colour colour) {
+    int shift = 7 - PALETTE_LUT_BITS;
+    int red = (colour.red & 0x7F) >> shift;
+    int green = (colour.green & 0x7F) >> shift;
+    int blue = (colour.blue & 0x7F) >> shift;
+    return palette_lut[(red << (2 * PALETTE_LUT_BITS)) | (green << PALETTE_LUT_BITS) | blue];
+}
+
+// The MK1 has four levels each of red and green, and no blue.  This is the
+// closest level for each channel value.
+#define MK1_LEVELS 4
+
+extern const uint8_t mk1_levels[128];
+
+// With PALETTE_DITHERING, MK1 colours that fall between two levels use a mix of
+// both across neighbouring pads, following a 4 x 4 Bayer matrix, rather than
+// all rounding the same way.
+#ifndef PALETTE_DITHERING
+#define PALETTE_DITHERING 0
+#endif
+
+#if PALETTE_DITHERING
+#define PALETTE_DITHER_THRESHOLDS 16
+
+extern const uint8_t mk1_dithered_levels[PALETTE_DITHER_THRESHOLDS][128];
+extern const uint8_t grid_dither_thresholds[LAUNCHPAD_GRID_CELLS];
+#endif
+
+// The red level in the bottom two bits and the green level in bits 4 and 5,
+// which is how the MK1 velocity is laid out.
+static inline uint8_t mk1_colour_for_cell(struct led_colour colour, int index) {
+#if PALETTE_DITHERING
+    const uint8_t *levels = mk1_dithered_levels[grid_dither_thresholds[index]];
+#else
+    const uint8_t *levels = mk1_levels;
+    (void) index;
+#endif
+    return (levels[colour.green & 0x7F] << 4) | levels[colour.red & 0x7F];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PALETTE_H_ */
@@ -0,0 +1,293 @@
+#include <string.h>
+#include "flash_region.h"
+#include "persistent_store.h"
+
+// "PLST"
+#define PERSISTENT_STORE_MAGIC 0x54534C50
+
+// Change this whenever struct persistent_state changes, so that we don't try
+// to load something saved by an older firmware.
+#define PERSISTENT_STORE_VERSION 1
+
+#define PERSISTENT_STORE_SLOTS (FLASH_REGION_SIZE / PERSISTENT_STORE_SLOT_SIZE)
+#define SLOTS_PER_SECTOR (FLASH_REGION_SECTOR_SIZE / PERSISTENT_STORE_SLOT_SIZE)
+#define PAGES_PER_SLOT (PERSISTENT_STORE_SLOT_SIZE / FLASH_REGION_PAGE_SIZE)
+
+struct slot_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;
+    uint32_t sequence;
+    uint32_t crc;
+};
+
+_Static_assert(sizeof(struct slot_header) + sizeof(struct persistent_state) <= PERSISTENT_STORE_SLOT_SIZE, "struct persistent_state doesn't fit in a slot");
+_Static_assert(PERSISTENT_STORE_SLOT_SIZE % FLASH_REGION_PAGE_SIZE == 0, "PERSISTENT_STORE_SLOT_SIZE should be a whole number of pages");
+_Static_assert(FLASH_REGION_SECTOR_SIZE % PERSISTENT_STORE_SLOT_SIZE == 0, "PERSISTENT_STORE_SLOT_SIZE should divide into sectors");
+
+enum PersistentStoreStep {
+  PERSISTENT_STORE_IDLE,
+  PERSISTENT_STORE_ERASING,
+  PERSISTENT_STORE_PROGRAMMING
+};
+
+// The newest valid slot, or -1 if there isn't one.
+static int latest_slot = -1;
+static uint32_t latest_sequence = 0;
+
+// Where the next save goes.
+static int next_slot = 0;
+
+// The state that's in flash, so that we don't save the same thing twice.
+static struct persistent_state saved_state;
+static bool has_saved_state = false;
+
+// The state waiting to be saved, and when it's due.
+static struct persistent_state pending_state;
+static bool has_pending_state = false;
+static uint32_t pending_since = 0;
+
+// The sector the ring moves into next, if it still needs erasing, or -1.
+static int spare_sector = -1;
+
+// The save we're part way through.
+static uint8_t step = PERSISTENT_STORE_IDLE;
+static uint32_t erase_due_since = 0;
+static uint8_t slot_buffer[PERSISTENT_STORE_SLOT_SIZE];
+static int target_slot = 0;
+static uint8_t next_page = 0;
+
+// The usual CRC-32, a bit at a time, as we only run it when loading and saving.
+static uint32_t crc32(const uint8_t *bytes, uint32_t length) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint32_t index = 0; index < length; index++) {
+    crc ^= bytes[index];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+static const uint8_t *slot_contents(int slot) {
+  return flash_region_contents() + (slot * PERSISTENT_STORE_SLOT_SIZE);
+}
+
+static bool is_slot_valid(int slot) {
+  const uint8_t *contents = slot_contents(slot);
+
+  struct slot_header header;
+  memcpy(&header, contents, sizeof(header));
+
+  return header.magic == PERSISTENT_STORE_MAGIC
+    && header.version == PERSISTENT_STORE_VERSION
+    && header.length == sizeof(struct persistent_state)
+    && header.crc == crc32(contents + sizeof(header), header.length);
+}
+
+static bool is_blank(const uint8_t *contents, uint32_t length) {
+  for (uint32_t index = 0; index < length; index++) {
+    if (contents[index] != 0xFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool is_slot_blank(int slot) {
+  return is_blank(slot_contents(slot), PERSISTENT_STORE_SLOT_SIZE);
+}
+
+static bool is_sector_blank(int sector) {
+  return is_blank(flash_region_contents() + (sector * FLASH_REGION_SECTOR_SIZE), FLASH_REGION_SECTOR_SIZE);
+}
+
+// Work out whether the sector the ring moves into after next_slot's has
+// anything in it, and so needs erasing before we get there.  Never the sector
+// with the newest save in it, which we'd lose.
+static void find_spare_sector(void) {
+  int sector = next_slot / SLOTS_PER_SECTOR;
+  if (next_slot % SLOTS_PER_SECTOR != 0) {
+    sector = (sector + 1) % FLASH_REGION_SECTORS;
+  }
+
+  bool is_latest_sector = latest_slot >= 0 && latest_slot / SLOTS_PER_SECTOR == sector;
+  spare_sector = !is_latest_sector && !is_sector_blank(sector) ? sector : -1;
+}
+
+static void erase_sector(int sector) {
+  flash_region_erase_sector(sector);
+  if (spare_sector == sector) {
+    spare_sector = -1;
+  }
+}
+
+// Find the newest save, and erase the sector the ring moves into next, so that
+// there's somewhere to save to without erasing anything for a while.  Reads go
+// straight to the flash region, so this is quick enough to do at boot.  Call
+// it before the other core starts, so that the erase doesn't pause anything.
+void persistent_store_init(void) {
+  latest_slot = -1;
+  latest_sequence = 0;
+
+  for (int slot = 0; slot < PERSISTENT_STORE_SLOTS; slot++) {
+    if (!is_slot_valid(slot)) {
+      continue;
+    }
+
+    struct slot_header header;
+    memcpy(&header, slot_contents(slot), sizeof(header));
+    if (latest_slot < 0 || header.sequence > latest_sequence) {
+      latest_slot = slot;
+      latest_sequence = header.sequence;
+    }
+  }
+
+  next_slot = (latest_slot + 1) % PERSISTENT_STORE_SLOTS;
+  has_saved_state = persistent_store_load(&saved_state);
+  has_pending_state = false;
+  step = PERSISTENT_STORE_IDLE;
+
+  find_spare_sector();
+  if (spare_sector >= 0) {
+    erase_sector(spare_sector);
+  }
+}
+
+bool persistent_store_load(struct persistent_state *state) {
+  if (latest_slot < 0) {
+    return false;
+  }
+
+  memcpy(state, slot_contents(latest_slot) + sizeof(struct slot_header), sizeof(*state));
+  return true;
+}
+
+// The newest state we know about, whether it's waiting, being written, or
+// already in flash.
+static const struct persistent_state *newest_state(void) {
+  if (has_pending_state) {
+    return &pending_state;
+  }
+
+  if (step != PERSISTENT_STORE_IDLE) {
+    return (const struct persistent_state *) (slot_buffer + sizeof(struct slot_header));
+  }
+
+  return has_saved_state ? &saved_state : NULL;
+}
+
+// Ask for `state` to be saved once things have settled down.  Callers should
+// clear the whole state (including any padding) before filling it in, so
+// that we can tell when nothing has changed.
+void persistent_store_request_save(const struct persistent_state *state, uint32_t now) {
+  const struct persistent_state *newest = newest_state();
+  if (newest != NULL && memcmp(newest, state, sizeof(*state)) == 0) {
+    return;
+  }
+
+  memcpy(&pending_state, state, sizeof(*state));
+  has_pending_state = true;
+  pending_since = now;
+}
+
+bool persistent_store_is_saving(void) {
+  return step != PERSISTENT_STORE_IDLE;
+}
+
+static void start_save(uint32_t now) {
+  struct slot_header header = {
+    PERSISTENT_STORE_MAGIC,
+    PERSISTENT_STORE_VERSION,
+    sizeof(struct persistent_state),
+    latest_sequence + 1,
+    crc32((const uint8_t *) &pending_state, sizeof(pending_state))
+  };
+
+  memset(slot_buffer, 0xFF, sizeof(slot_buffer));
+  memcpy(slot_buffer, &header, sizeof(header));
+  memcpy(slot_buffer + sizeof(header), &pending_state, sizeof(pending_state));
+
+  // The slot after the newest one, unless something has been left there, e.g.
+  // by a save that was cut off, in which case we move on to a fresh sector.
+  target_slot = next_slot;
+  if (target_slot % SLOTS_PER_SECTOR != 0 && !is_slot_blank(target_slot)) {
+    target_slot = ((target_slot / SLOTS_PER_SECTOR + 1) * SLOTS_PER_SECTOR) % PERSISTENT_STORE_SLOTS;
+  }
+
+  // A sector that wasn't erased ahead of time is erased before we start
+  // filling it again.
+  bool needs_erase = target_slot % SLOTS_PER_SECTOR == 0 && !is_sector_blank(target_slot / SLOTS_PER_SECTOR);
+  step = needs_erase ? PERSISTENT_STORE_ERASING : PERSISTENT_STORE_PROGRAMMING;
+  erase_due_since = now;
+
+  // Anything that changes from here on is saved next time.
+  has_pending_state = false;
+  next_page = 0;
+}
+
+static void finish_save(void) {
+  step = PERSISTENT_STORE_IDLE;
+  next_slot = (target_slot + 1) % PERSISTENT_STORE_SLOTS;
+
+  // If the write didn't take, try again with the next slot, unless there's
+  // already something newer to save.
+  if (!is_slot_valid(target_slot)) {
+    if (!has_pending_state) {
+      memcpy(&pending_state, slot_buffer + sizeof(struct slot_header), sizeof(pending_state));
+      has_pending_state = true;
+    }
+    return;
+  }
+
+  latest_slot = target_slot;
+  latest_sequence++;
+  memcpy(&saved_state, slot_buffer + sizeof(struct slot_header), sizeof(saved_state));
+  has_saved_state = true;
+
+  // Once we've moved into a new sector, the one after it can be erased.
+  if (target_slot % SLOTS_PER_SECTOR == 0) {
+    find_spare_sector();
+  }
+}
+
+// Call this whenever there's nothing else to do.  It does at most one erase or
+// one page program, which pauses the other core while it runs, so callers
+// should avoid calling this while they're painting or have output waiting.
+//
+// The next sector is erased ahead of time whenever `can_erase` is set.  If a
+// save needs a sector that still hasn't been erased, it waits for `can_erase`
+// for up to PERSISTENT_STORE_ERASE_DEADLINE_US, and then erases it anyway.
+void persistent_store_task(uint32_t now, bool can_erase) {
+  switch (step) {
+    case PERSISTENT_STORE_IDLE:
+      if (has_pending_state && (now - pending_since) >= PERSISTENT_STORE_SAVE_DELAY_US) {
+        start_save(now);
+      }
+      else if (can_erase && spare_sector >= 0) {
+        erase_sector(spare_sector);
+      }
+      break;
+    case PERSISTENT_STORE_ERASING:
+      if (can_erase || (now - erase_due_since) >= PERSISTENT_STORE_ERASE_DEADLINE_US) {
+        erase_sector(target_slot / SLOTS_PER_SECTOR);
+        step = PERSISTENT_STORE_PROGRAMMING;
+      }
+      break;
+    case PERSISTENT_STORE_PROGRAMMING:
+      // The header goes in last, so a slot only looks valid once it's complete.
+      {
+        uint8_t page = (next_page + 1) % PAGES_PER_SLOT;
+        uint32_t offset = (target_slot * PERSISTENT_STORE_SLOT_SIZE) + (page * FLASH_REGION_PAGE_SIZE);
+        flash_region_program_page(offset, slot_buffer + (page * FLASH_REGION_PAGE_SIZE));
+        next_page++;
+      }
+
+      if (next_page == PAGES_PER_SLOT) {
+        finish_save();
+      }
+      break;
+    default:
+      break;
+  }
+}
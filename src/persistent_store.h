@@ -0,0 +1,70 @@
+#ifndef _PERSISTENT_STORE_H_
+#define _PERSISTENT_STORE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "device_cache.h"
+#include "midi_router.h"
+#include "tusb.h"
+
+// Keeps the state we want back after a power cut in the flash region (see
+// flash_region.h), so that a rig comes back as it was left.
+//
+// The region is treated as a ring of fixed size slots, and each save goes in
+// the slot after the last one, so every sector is erased equally often.  Each
+// slot starts with a header that includes a CRC of the state, so a save that
+// was cut off part way through is ignored, and we fall back to the one before.
+//
+// Saves are never written straight away.  The newest state waits in RAM until
+// nothing has changed for PERSISTENT_STORE_SAVE_DELAY_US, and is then written
+// one erase or page at a time, whenever the caller has nothing else to do, see
+// persistent_store_task.
+//
+// Nothing can run from flash while it's being changed, so the other core is
+// paused for each step.  Programming a page takes around a millisecond, which
+// the host stack can live with.  Erasing a sector takes tens of milliseconds,
+// long enough for devices on the host port to miss their frames, so we keep
+// the next sector erased ahead of time: once at boot, before the other core
+// starts, and after that whenever the caller says there's nothing that would
+// notice.  If a save still finds its sector unerased, it waits for a quiet
+// moment for up to PERSISTENT_STORE_ERASE_DEADLINE_US, and then erases it
+// between frames anyway, so that saves are never held up for good.
+
+#define PERSISTENT_STORE_SAVE_DELAY_US 2000000
+
+#define PERSISTENT_STORE_ERASE_DEADLINE_US 30000000
+
+#define PERSISTENT_STORE_SLOT_SIZE 512
+
+struct persistent_state {
+    uint8_t active_row;
+    uint8_t active_column;
+
+    uint8_t client_models[CFG_TUD_MIDI_NUMCABLES_OUT];
+
+    struct device_cache_entry device_cache[DEVICE_CACHE_ENTRIES];
+
+    uint8_t route_count;
+    struct midi_route_config routes[MIDI_ROUTER_MAX_ROUTES];
+};
+
+void persistent_store_init(void);
+
+bool persistent_store_load(struct persistent_state*);
+
+void persistent_store_request_save(const struct persistent_state*, uint32_t);
+
+bool persistent_store_is_saving(void);
+
+void persistent_store_task(uint32_t, bool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _PERSISTENT_STORE_H_ */
@@ -8,6 +8,7 @@
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
 #include "pico/bootrom.h"
+#include "pico/flash.h"
 
 // TODO: Make these options configurable with conditional blocks
 
@@ -43,26 +44,84 @@
 
 #include "midi_device_multistream.h"
 
+#include "animation.h"
+#include "compositor.h"
+#include "device_inquiry.h"
+#include "diagnostics.h"
+#include "host_enumeration.h"
+#include "input_queue.h"
 #include "launchpad.h"
-
+#include "midi_router.h"
+#include "persistent_store.h"
+#include "render_queue.h"
+#include "render_scheduler.h"
+#include "sysex_assembler.h"
+
+// Only core0 should ever change this, core1 sends its changes through the
+// input queue.  The cursor comes back from flash at boot, see restore_state.
 static struct board_state board_state = {
-  4, 5, true, {0, UNkNOWN}
+  4, 5, true
+};
+
+static struct input_queue host_input_queue;
+
+// Packets core0 has routed to host devices, for core1 to send.
+static struct input_queue host_forward_queue;
+
+// Frames for core1 to paint on host devices.
+static struct render_queue host_render_queue;
+
+static struct render_scheduler render_scheduler;
+
+// Set this to forward whatever the devices on the host port play to the
+// computer, on the diagnostics cable.  The other client cables stand in for
+// Launchpads, so anything forwarded to them would light up their pads.  More
+// routes can be added with midi_router_add_route.
+#ifndef FORWARD_HOST_INPUT_TO_CLIENT
+#define FORWARD_HOST_INPUT_TO_CLIENT 0
+#endif
+
+#if FORWARD_HOST_INPUT_TO_CLIENT
+static const struct midi_route default_routes[] = {
+  {
+    .source = { MIDI_ENDPOINT_HOST, MIDI_ENDPOINT_ANY },
+    .destination = { MIDI_ENDPOINT_CLIENT, DIAGNOSTICS_CABLE },
+    .message_types = MIDI_ROUTE_NOTES | MIDI_ROUTE_CONTROL_CHANGE | MIDI_ROUTE_CHANNEL_PRESSURE
+  }
 };
+#endif
 
 // End state variables
 
 void midi_client_task(void);
+void host_input_task(void);
+void host_output_task(void);
+bool forward_host_packet(uint8_t, const uint8_t*);
+bool forward_client_sysex(uint8_t, const uint8_t*, uint16_t);
+bool forward_host_sysex(uint8_t, const uint8_t*, uint16_t);
+void route_sysex(struct midi_endpoint, const uint8_t*, uint16_t);
+void host_device_enumerated(uint8_t, enum LaunchpadModel);
+void device_identified(struct midi_endpoint, enum LaunchpadModel, const struct device_inquiry_reply*);
+void restore_state(void);
+void save_state(void);
+bool is_host_device_mounted(void);
 
 void core1_main() {
   sleep_ms(10);
 
+  // Let core0 pause us while it writes to flash, see flash_region.c.
+  flash_safe_execute_core_init();
+
   pio_usb_configuration_t pio_cfg = PIO_USB_CONFIG;
   tuh_configure(1, TUH_CFGID_RPI_PIO_USB_CONFIGURATION, &pio_cfg);
 
+  host_enumeration_init(host_device_enumerated);
   tuh_init(BOARD_TUH_RHPORT);
 
   while (true) {
     tuh_task();
+
+    host_output_task();
   }
 }
 
@@ -84,26 +143,70 @@ int main() {
   // Give the client side a brief chance to start up.
   sleep_ms(10);
 
+  input_queue_init(&host_input_queue);
+  input_queue_init(&host_forward_queue);
+  render_queue_init(&host_render_queue);
+
+  initialise_diagnostics();
+  initialise_device_inquiry(device_identified);
+
+  midi_router_init(write_client_packet, forward_host_packet, forward_client_sysex, forward_host_sysex);
+
+  static const uint8_t any_sysex[] = { 0xF0 };
+  sysex_assembler_register_handler(any_sysex, sizeof(any_sysex), route_sysex);
+
+  // This needs to happen before core1 starts, as it owns the device cache, and
+  // the store may erase flash, which would otherwise pause the host port.
+  restore_state();
+
   multicore_reset_core1();
   multicore_launch_core1(core1_main);
 
   // Start the device stack on the native USB port.
   tud_init(0);
 
+  render_scheduler_init(&render_scheduler, RENDER_FRAME_RATE, time_us_32());
+
   while (true)
   {
     tud_task(); // tinyusb device task
 
     midi_client_task();
 
-    if (board_state.is_dirty) {
-      paint_client_launchpads(&board_state);
+    service_client_launchpads();
+
+    host_input_task();
+
+    // The outputs are still busy if the client cables haven't sent everything
+    // from the last frame yet, or core1 hasn't picked up the last frame.
+    bool is_busy = is_client_output_busy() || !render_queue_is_empty(&host_render_queue);
 
-      if (tuh_midi_mounted(board_state.host.client_idx)) {
-        paint_host_launchpad(&board_state);
+    // Anything drawn on the compositor's layers also needs painting, as does
+    // every step of an animation, for devices that can't animate pads
+    // themselves.
+    board_state.is_dirty = board_state.is_dirty || compositor_is_dirty(get_board_compositor()) || animator_needs_frame(get_board_animator(), time_us_32());
+
+    if (render_scheduler_should_paint(&render_scheduler, time_us_32(), board_state.is_dirty, is_busy)) {
+      struct render_command command = { RENDER_COMMAND_FRAME };
+      render_board_frame(&board_state, &command.frame);
+
+      paint_client_launchpads(&command.frame);
+
+      // If core1 hasn't caught up yet, we try again next time round, by which
+      // point there may be an even newer frame to send.  The client cables
+      // already have this frame, so they won't be sent it again.
+      board_state.is_dirty = !render_queue_push(&host_render_queue, &command);
+      if (!board_state.is_dirty) {
+        board_state.has_pending_input = false;
       }
 
-      board_state.is_dirty = false;
+      save_state();
+    }
+    else if (!is_busy && !board_state.is_dirty) {
+      // Writing to flash pauses core1, so we only do it when there's nothing
+      // to paint or send, and erase ahead of time only when there's nothing on
+      // the host port for the pause to upset.
+      persistent_store_task(time_us_32(), !is_host_device_mounted());
     }
   }
 }
@@ -118,6 +221,14 @@ int main() {
 // Invoked when device is mounted
 void tud_mount_cb(void) {
     initialise_client_launchpads();
+
+    // Find out what's really on the other end of each cable.  Launchpads that
+    // don't answer keep the model their cable started with.
+    for (uint8_t cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+      if (cable != DIAGNOSTICS_CABLE) {
+        write_client_message(cable, device_inquiry_request, DEVICE_INQUIRY_REQUEST_LENGTH);
+      }
+    }
 }
 
 // Invoked when device is unmounted
@@ -139,37 +250,48 @@ void tud_resume_cb(void) {}
 // The empty placeholder callbacks would ordinarily throw warnings about unused variables, so we use the strategy outlined here:
 // https://stackoverflow.com/questions/3599160/how-can-i-suppress-unused-parameter-warnings-in-c
 
-// Nicked from: https://github.com/hathach/tinyusb/blob/6ce46da042eb9ab243e4127ddcac57519c0a226f/examples/host/device_info/src/main.c#L118
-
-// Declare for buffer for usb transfer, may need to be in USB/DMA section and
-// multiple of dcache line size if dcache is enabled (for some ports).
-CFG_TUH_MEM_SECTION struct {
-  TUH_EPBUF_TYPE_DEF(tusb_desc_device_t, device);
-  TUH_EPBUF_DEF(serial, 64*sizeof(uint16_t));
-  TUH_EPBUF_DEF(buf, 128*sizeof(uint16_t));
-} desc;
+// Invoked once we know which model a newly mounted device is, see
+// host_enumeration.c.  We're already on core1, so we can set up the output
+// side straight away, and let core0 know so that it can handle input and
+// repaint.
+void host_device_enumerated(uint8_t idx, enum LaunchpadModel model) {
+  initialise_host_launchpad(idx, model);
+
+  // If the IDs didn't tell us what the device is, it may still answer a
+  // device inquiry, see device_identified.
+  if (model == LAUNCHPAD_MODEL_UNKNOWN) {
+    write_host_message(idx, 0, device_inquiry_request, DEVICE_INQUIRY_REQUEST_LENGTH);
+  }
 
-// Invoked when device with MIDI interface is mounted.
-void tuh_midi_mount_cb(uint8_t idx, __attribute__((unused)) const tuh_midi_mount_cb_t* mount_cb_data) {
-  board_state.host.client_idx = idx;
+  struct input_event event = {
+    time_us_32(), INPUT_EVENT_HOST_MOUNTED, idx, { model, 0, 0, 0 }
+  };
+  input_queue_push(&host_input_queue, &event);
+}
 
+// Invoked when device with MIDI interface is mounted.  Reading the device's
+// descriptors takes a few control transfers, which we don't wait for here, so
+// that the devices that are already running aren't held up.
+void tuh_midi_mount_cb(uint8_t idx, const tuh_midi_mount_cb_t* mount_cb_data) {
   // printf("MIDI Interface Index = %u, Address = %u, Number of RX cables = %u, Number of TX cables = %u\r\n",
   // idx, mount_cb_data->daddr, mount_cb_data->rx_cable_count, mount_cb_data->tx_cable_count);
 
-  // TODO: Set up something to contain the device descriptor.
-
-  // Adapted from: https://github.com/hathach/tinyusb/blob/master/examples/host/device_info/src/main.c
-
-  // tusb_xfer_result_t tuh_descriptor_get_device_sync(uint8_t daddr, void* buffer, uint16_t len) {
-  tuh_descriptor_get_device_sync(mount_cb_data->daddr, &desc.device, 18);
-
-  // printf("Device %u: ID %04x:%04x SN ", daddr, desc.device.idVendor, desc.device.idProduct);
-  board_state.host.launchpad_version = get_launchpad_version(desc.device.idVendor, desc.device.idProduct);
+  if (idx < MAX_HOST_LAUNCHPADS) {
+    host_enumeration_start(idx, mount_cb_data->daddr);
+  }
 }
 
 // Invoked when device with MIDI interface is un-mounted
-void tuh_midi_umount_cb(__attribute__((unused)) uint8_t idx) {
-  board_state.host.client_idx = 0;
+void tuh_midi_umount_cb(uint8_t idx) {
+  if (idx < MAX_HOST_LAUNCHPADS) {
+    host_enumeration_cancel(idx);
+    release_host_launchpad(idx);
+  }
+
+  struct input_event event = {
+    time_us_32(), INPUT_EVENT_HOST_UNMOUNTED, idx, { 0, 0, 0, 0 }
+  };
+  input_queue_push(&host_input_queue, &event);
 }
 
 void tuh_midi_rx_cb(uint8_t idx, uint32_t xferred_bytes) {
@@ -177,9 +299,12 @@ void tuh_midi_rx_cb(uint8_t idx, uint32_t xferred_bytes) {
     return;
   }
 
-  uint8_t incoming_packet[4];
-  while (tuh_midi_packet_read(idx, incoming_packet)) {
-    process_incoming_host_packet(incoming_packet, &board_state);
+  struct input_event event = {
+    time_us_32(), INPUT_EVENT_HOST_PACKET, idx, { 0, 0, 0, 0 }
+  };
+
+  while (tuh_midi_packet_read(idx, event.data)) {
+    input_queue_push(&host_input_queue, &event);
   }
 }
 
@@ -193,15 +318,242 @@ void tuh_midi_tx_cb(uint8_t idx, uint32_t xferred_bytes) {
 //--------------------------------------------------------------------+
 // MIDI Tasks
 //--------------------------------------------------------------------+
+// If an input means we need to repaint, remember when it arrived, so that we
+// can measure how long it takes for the repaint to go out.
+static void note_input_time(uint32_t timestamp)
+{
+  if (board_state.is_dirty && !board_state.has_pending_input) {
+    board_state.has_pending_input = true;
+    board_state.pending_input_time = timestamp;
+  }
+}
+
 void midi_client_task(void)
 {
   while (tud_midi_available()) {
     uint8_t incoming_packet[4];
     tud_midi_packet_read(incoming_packet);
+    uint32_t timestamp = time_us_32();
+
+    uint8_t cable = incoming_packet[0] >> 4;
+    struct midi_endpoint source = { MIDI_ENDPOINT_CLIENT, cable };
+
+    if (is_sysex_packet(incoming_packet)) {
+      sysex_assembler_process_packet(source, incoming_packet);
+    }
+
+    if (cable == DIAGNOSTICS_CABLE) {
+      continue;
+    }
 
-    // Temporarily "loopback" internally.
-    tud_midi_packet_write(incoming_packet);
+    midi_router_route_packet(source, incoming_packet);
 
     process_incoming_client_packet(incoming_packet, &board_state);
+    note_input_time(timestamp);
+  }
+}
+
+// Runs on core1: paint the newest frame from core0 on every host device, and
+// feed whatever the devices are ready for into the host stack.
+void host_output_task(void)
+{
+  static struct render_command command;
+  if (render_queue_pop_latest(&host_render_queue, &command)) {
+    paint_host_launchpads(&command.frame);
+  }
+
+  struct input_event event;
+  while (input_queue_pop(&host_forward_queue, &event)) {
+    if (event.type == INPUT_EVENT_HOST_IDENTIFIED) {
+      host_enumeration_remember_model(event.client_idx, event.data[0]);
+      host_device_enumerated(event.client_idx, event.data[0]);
+    }
+    else {
+      write_host_packet(event.client_idx, event.data);
+    }
+  }
+
+  service_host_launchpads();
+}
+
+// Put things back the way they were before we lost power, or set up the
+// defaults if there's nothing saved.
+void restore_state(void)
+{
+  persistent_store_init();
+
+  struct persistent_state state;
+  if (!persistent_store_load(&state)) {
+#if FORWARD_HOST_INPUT_TO_CLIENT
+    for (size_t route = 0; route < sizeof(default_routes) / sizeof(default_routes[0]); route++) {
+      midi_router_add_route(&default_routes[route]);
+    }
+#endif
+    return;
+  }
+
+  if (state.active_row < LAUNCHPAD_GRID_SIZE && state.active_column < LAUNCHPAD_GRID_SIZE) {
+    board_state.active_row = state.active_row;
+    board_state.active_column = state.active_column;
+  }
+
+  for (uint8_t cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    if (state.client_models[cable] < LAUNCHPAD_MODEL_COUNT) {
+      set_client_model(cable, state.client_models[cable]);
+    }
+  }
+
+  device_cache_import(state.device_cache);
+  midi_router_restore_routes(state.routes, state.route_count);
+}
+
+// Ask for the current state to be saved, once it's settled down.
+void save_state(void)
+{
+  struct persistent_state state;
+  memset(&state, 0, sizeof(state));
+
+  state.active_row = board_state.active_row;
+  state.active_column = board_state.active_column;
+
+  for (uint8_t cable = 0; cable < CFG_TUD_MIDI_NUMCABLES_OUT; cable++) {
+    state.client_models[cable] = get_client_model(cable);
+  }
+
+  device_cache_export(state.device_cache);
+  state.route_count = midi_router_save_routes(state.routes);
+
+  persistent_store_request_save(&state, time_us_32());
+}
+
+// Whether anything on the host port would notice core1 being paused.
+bool is_host_device_mounted(void)
+{
+  for (uint8_t client_idx = 0; client_idx < MAX_HOST_LAUNCHPADS; client_idx++) {
+    if (board_state.host.devices[client_idx].is_mounted) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Called by the router on core0, hands a packet to core1 to send to a host
+// device.
+bool forward_host_packet(uint8_t client_idx, const uint8_t *packet)
+{
+  struct input_event event = {
+    time_us_32(), INPUT_EVENT_HOST_PACKET, client_idx, { packet[0], packet[1], packet[2], packet[3] }
+  };
+  return input_queue_push(&host_forward_queue, &event);
+}
+
+// Called by the router on core0 with a whole sysex message for a client cable,
+// which is queued in one piece.
+bool forward_client_sysex(uint8_t cable, const uint8_t *message, uint16_t length)
+{
+  return write_client_message(cable, message, length);
+}
+
+// Called by the router on core0 with a whole sysex message for a host device.
+// We only hand it to core1 if there's room for every packet, and core1 holds
+// on to them until the last one arrives, see write_host_packet.
+bool forward_host_sysex(uint8_t client_idx, const uint8_t *message, uint16_t length)
+{
+  uint8_t packets[SYSEX_MAX_PACKETS][USB_MIDI_PACKET_SIZE];
+  if (length > SYSEX_MAX_MESSAGE_LENGTH) {
+    return false;
+  }
+
+  uint32_t packet_count = usb_midi_frame_messages(0, message, length, packets[0]);
+  if (input_queue_free(&host_forward_queue) < packet_count) {
+    return false;
+  }
+
+  for (uint32_t packet = 0; packet < packet_count; packet++) {
+    forward_host_packet(client_idx, packets[packet]);
+  }
+
+  return true;
+}
+
+// Every complete sysex message goes to the router, apart from the requests on
+// the diagnostics cable.
+void route_sysex(struct midi_endpoint source, const uint8_t *message, uint16_t length)
+{
+  if (source.type == MIDI_ENDPOINT_CLIENT && source.index == DIAGNOSTICS_CABLE) {
+    return;
+  }
+
+  midi_router_route_sysex(source, message, length);
+}
+
+// Called on core0 with each device inquiry reply.  Client cables switch to the
+// model that answered straight away.  Host devices belong to core1, so we ask
+// it to set the device up again as the right model.
+void device_identified(struct midi_endpoint source, enum LaunchpadModel model, __attribute__((unused)) const struct device_inquiry_reply *reply)
+{
+  if (model == LAUNCHPAD_MODEL_UNKNOWN) {
+    return;
+  }
+
+  if (source.type == MIDI_ENDPOINT_CLIENT) {
+    if (source.index != DIAGNOSTICS_CABLE && get_client_model(source.index) != model) {
+      set_client_model(source.index, model);
+      board_state.is_dirty = true;
+    }
+    return;
+  }
+
+  if (source.index >= MAX_HOST_LAUNCHPADS) {
+    return;
+  }
+
+  const struct host_device *device = &board_state.host.devices[source.index];
+  if (device->is_mounted && device->model != model) {
+    struct input_event event = {
+      time_us_32(), INPUT_EVENT_HOST_IDENTIFIED, source.index, { model, 0, 0, 0 }
+    };
+    input_queue_push(&host_forward_queue, &event);
+  }
+}
+
+// Apply everything core1 has heard from the host port since we last checked.
+void host_input_task(void)
+{
+  struct input_event event;
+  while (input_queue_pop(&host_input_queue, &event)) {
+    if (event.client_idx >= MAX_HOST_LAUNCHPADS) {
+      continue;
+    }
+
+    struct host_device *device = &board_state.host.devices[event.client_idx];
+    struct midi_endpoint source = { MIDI_ENDPOINT_HOST, event.client_idx };
+
+    switch (event.type) {
+      case INPUT_EVENT_HOST_PACKET:
+        process_incoming_host_packet(event.client_idx, event.data, &board_state);
+        note_input_time(event.timestamp);
+
+        if (is_sysex_packet(event.data)) {
+          sysex_assembler_process_packet(source, event.data);
+        }
+
+        midi_router_route_packet(source, event.data);
+        break;
+      case INPUT_EVENT_HOST_MOUNTED:
+        device->model = event.data[0];
+        device->is_mounted = true;
+
+        board_state.is_dirty = true;
+        break;
+      case INPUT_EVENT_HOST_UNMOUNTED:
+        sysex_assembler_reset(source);
+        device->is_mounted = false;
+        device->model = LAUNCHPAD_MODEL_UNKNOWN;
+        break;
+      default:
+        break;
+    }
   }
 }
@@ -0,0 +1,51 @@
+#include "render_queue.h"
+
+void render_queue_init(struct render_queue *queue) {
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->overflow_count, 0);
+}
+
+// Only call this from the producer (core0).
+bool render_queue_push(struct render_queue *queue, const struct render_command *command) {
+  unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+  if (tail - head >= RENDER_QUEUE_LENGTH) {
+    atomic_store_explicit(&queue->overflow_count, atomic_load_explicit(&queue->overflow_count, memory_order_relaxed) + 1, memory_order_relaxed);
+    return false;
+  }
+
+  queue->commands[tail & (RENDER_QUEUE_LENGTH - 1)] = *command;
+
+  // Publish the command only once it's been written in full.
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+  return true;
+}
+
+// Whether the consumer has taken everything we've pushed so far.
+bool render_queue_is_empty(struct render_queue *queue) {
+  unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+  unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+  return head == tail;
+}
+
+// Only call this from the consumer (core1).  Every frame replaces the one
+// before it, so we skip straight to the newest command and discard the rest.
+bool render_queue_pop_latest(struct render_queue *queue, struct render_command *command) {
+  unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+  if (head == tail) {
+    return false;
+  }
+
+  *command = queue->commands[(tail - 1) & (RENDER_QUEUE_LENGTH - 1)];
+
+  // Hand the slots back to the producer only once we've copied the command out.
+  atomic_store_explicit(&queue->head, tail, memory_order_release);
+
+  return true;
+}
@@ -0,0 +1,57 @@
+#ifndef _RENDER_QUEUE_H_
+#define _RENDER_QUEUE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "launchpad.h"
+
+// Core0 works out what each frame should look like, but core1 owns the host
+// stack, and does all of the encoding and writing for host devices.  Finished
+// frames go from core0 to core1 through a single producer, single consumer
+// ring buffer, which works the same way as the input queue.
+
+enum RenderCommandType {
+  RENDER_COMMAND_FRAME
+};
+
+struct render_command {
+    uint8_t type;
+    struct led_frame frame;
+};
+
+// Must be a power of two.  Only the newest frame matters, so this only needs
+// to be long enough that core0 rarely has to wait for core1.
+#define RENDER_QUEUE_LENGTH 4
+
+struct render_queue {
+    struct render_command commands[RENDER_QUEUE_LENGTH];
+
+    // The next command to read, only written by the consumer.
+    atomic_uint head;
+
+    // The next free slot, only written by the producer.
+    atomic_uint tail;
+
+    // How many times the producer found the queue full.
+    atomic_uint overflow_count;
+};
+
+void render_queue_init(struct render_queue*);
+
+bool render_queue_push(struct render_queue*, const struct render_command*);
+
+bool render_queue_is_empty(struct render_queue*);
+
+bool render_queue_pop_latest(struct render_queue*, struct render_command*);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RENDER_QUEUE_H_ */
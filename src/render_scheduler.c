@@ -0,0 +1,43 @@
+#include "render_scheduler.h"
+
+void render_scheduler_init(struct render_scheduler *scheduler, uint32_t frame_rate, uint32_t now) {
+  scheduler->frame_interval_us = 1000000 / frame_rate;
+  scheduler->next_frame_time = now;
+  scheduler->consecutive_skips = 0;
+  scheduler->frames_painted = 0;
+  scheduler->frames_skipped = 0;
+}
+
+// Decide whether to paint now.  We only paint at the start of a frame, only if
+// something has changed, and only if the outputs have finished with whatever we
+// painted last time (or we've already waited RENDER_MAX_SKIPPED_FRAMES for
+// them).  If we don't paint, the changes are left for the next frame, where
+// they're painted together with anything else that changes in the meantime.
+bool render_scheduler_should_paint(struct render_scheduler *scheduler, uint32_t now, bool is_dirty, bool is_busy) {
+  // Compare the difference rather than the times themselves, so that we cope
+  // with the microsecond timer wrapping around.
+  if ((int32_t) (now - scheduler->next_frame_time) < 0) {
+    return false;
+  }
+
+  if (!is_dirty) {
+    return false;
+  }
+
+  // If we've fallen more than a frame behind, start counting again from now
+  // rather than trying to catch up.
+  scheduler->next_frame_time += scheduler->frame_interval_us;
+  if ((int32_t) (now - scheduler->next_frame_time) >= 0) {
+    scheduler->next_frame_time = now + scheduler->frame_interval_us;
+  }
+
+  if (is_busy && scheduler->consecutive_skips < RENDER_MAX_SKIPPED_FRAMES) {
+    scheduler->consecutive_skips++;
+    scheduler->frames_skipped++;
+    return false;
+  }
+
+  scheduler->consecutive_skips = 0;
+  scheduler->frames_painted++;
+  return true;
+}
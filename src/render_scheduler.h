@@ -0,0 +1,45 @@
+#ifndef _RENDER_SCHEDULER_H_
+#define _RENDER_SCHEDULER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Rather than repainting every time something changes, we paint at most once
+// per frame, so that a burst of button presses becomes a single paint of the
+// newest state, instead of a backlog of paints the bus can't keep up with.
+
+// Frames per second, something between 60 and 120 is sensible.
+#ifndef RENDER_FRAME_RATE
+#define RENDER_FRAME_RATE 100
+#endif
+
+// The most frames in a row we'll skip while the outputs are busy, so that
+// changes are never delayed by more than a few frames.
+#ifndef RENDER_MAX_SKIPPED_FRAMES
+#define RENDER_MAX_SKIPPED_FRAMES 2
+#endif
+
+struct render_scheduler {
+    uint32_t frame_interval_us;
+    uint32_t next_frame_time;
+    uint32_t consecutive_skips;
+
+    // Frames we've painted, and frames we skipped because the outputs were
+    // still busy with an earlier frame.
+    uint32_t frames_painted;
+    uint32_t frames_skipped;
+};
+
+void render_scheduler_init(struct render_scheduler*, uint32_t, uint32_t);
+
+bool render_scheduler_should_paint(struct render_scheduler*, uint32_t, bool, bool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RENDER_SCHEDULER_H_ */
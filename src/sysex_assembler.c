@@ -0,0 +1,124 @@
+#include <string.h>
+#include "launchpad.h"
+#include "sysex_assembler.h"
+#include "tusb.h"
+
+struct sysex_assembler {
+    uint8_t buffer[SYSEX_MAX_MESSAGE_LENGTH];
+    uint16_t length;
+
+    // Whether we've seen the F0h that starts the current message.
+    bool is_active;
+
+    // Whether the current message has outgrown the buffer, in which case we
+    // drop the rest of it.
+    bool is_overflowing;
+};
+
+struct sysex_handler_entry {
+    uint8_t prefix[SYSEX_MAX_PREFIX_LENGTH];
+    uint8_t prefix_length;
+    sysex_handler handler;
+};
+
+static struct sysex_assembler client_assemblers[CFG_TUD_MIDI_NUMCABLES_OUT];
+static struct sysex_assembler host_assemblers[MAX_HOST_LAUNCHPADS];
+
+static struct sysex_handler_entry handlers[SYSEX_MAX_HANDLERS];
+static uint8_t handler_count = 0;
+
+// Handlers get every complete message that starts with `prefix`, in the order
+// they were registered.
+bool sysex_assembler_register_handler(const uint8_t *prefix, uint8_t prefix_length, sysex_handler handler) {
+  if (handler_count >= SYSEX_MAX_HANDLERS || prefix_length > SYSEX_MAX_PREFIX_LENGTH) {
+    return false;
+  }
+
+  struct sysex_handler_entry *entry = &handlers[handler_count++];
+  memcpy(entry->prefix, prefix, prefix_length);
+  entry->prefix_length = prefix_length;
+  entry->handler = handler;
+  return true;
+}
+
+static struct sysex_assembler *get_assembler(struct midi_endpoint source) {
+  if (source.type == MIDI_ENDPOINT_CLIENT && source.index < CFG_TUD_MIDI_NUMCABLES_OUT) {
+    return &client_assemblers[source.index];
+  }
+
+  if (source.type == MIDI_ENDPOINT_HOST && source.index < MAX_HOST_LAUNCHPADS) {
+    return &host_assemblers[source.index];
+  }
+
+  return NULL;
+}
+
+// Forget any partial message, e.g. when a host device is unplugged.
+void sysex_assembler_reset(struct midi_endpoint source) {
+  struct sysex_assembler *assembler = get_assembler(source);
+  if (assembler != NULL) {
+    assembler->is_active = false;
+    assembler->is_overflowing = false;
+    assembler->length = 0;
+  }
+}
+
+static void dispatch_message(struct midi_endpoint source, const uint8_t *message, uint16_t length) {
+  for (uint8_t index = 0; index < handler_count; index++) {
+    const struct sysex_handler_entry *entry = &handlers[index];
+    if (length >= entry->prefix_length && memcmp(message, entry->prefix, entry->prefix_length) == 0) {
+      entry->handler(source, message, length);
+    }
+  }
+}
+
+void sysex_assembler_process_packet(struct midi_endpoint source, const uint8_t *packet) {
+  struct sysex_assembler *assembler = get_assembler(source);
+  if (assembler == NULL) {
+    return;
+  }
+
+  uint8_t code_index = packet[0] & 0x0F;
+
+  uint16_t data_length;
+  if (code_index == MIDI_CIN_SYSEX_START) {
+    data_length = 3;
+  }
+  else if (code_index >= MIDI_CIN_SYSEX_END_1BYTE && code_index <= MIDI_CIN_SYSEX_END_3BYTE) {
+    data_length = code_index - MIDI_CIN_SYSEX_END_1BYTE + 1;
+  }
+  else {
+    return;
+  }
+
+  // A new message always starts with F0h, even if the last one never ended.
+  if (packet[1] == 0xF0) {
+    assembler->is_active = true;
+    assembler->is_overflowing = false;
+    assembler->length = 0;
+  }
+
+  // Code index 5h is also used for single byte system common messages, which
+  // aren't part of any sysex.
+  if (!assembler->is_active) {
+    return;
+  }
+
+  if (assembler->length + data_length > SYSEX_MAX_MESSAGE_LENGTH) {
+    assembler->is_overflowing = true;
+  }
+  else if (!assembler->is_overflowing) {
+    memcpy(assembler->buffer + assembler->length, packet + 1, data_length);
+    assembler->length += data_length;
+  }
+
+  if (code_index != MIDI_CIN_SYSEX_START) {
+    if (!assembler->is_overflowing) {
+      dispatch_message(source, assembler->buffer, assembler->length);
+    }
+
+    assembler->is_active = false;
+    assembler->is_overflowing = false;
+    assembler->length = 0;
+  }
+}
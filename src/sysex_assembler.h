@@ -0,0 +1,51 @@
+#ifndef _SYSEX_ASSEMBLER_H_
+#define _SYSEX_ASSEMBLER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "midi_router.h"
+
+// Puts sysex messages back together as their packets arrive, one message at
+// a time for each client cable and host device, and hands each complete
+// message to whichever handlers are interested in it.  Everything lives in
+// fixed buffers, so nothing is allocated.
+
+// Longer messages are dropped, and aren't forwarded either.  The longest we
+// expect is a device inquiry reply, at 17 bytes.
+#define SYSEX_MAX_MESSAGE_LENGTH 64
+
+// The most USB MIDI packets a message we keep can take, three bytes at a time.
+#define SYSEX_MAX_PACKETS ((SYSEX_MAX_MESSAGE_LENGTH + 2) / 3)
+
+#define SYSEX_MAX_HANDLERS 8
+
+// The longest prefix a handler can ask for, including F0h.
+#define SYSEX_MAX_PREFIX_LENGTH 8
+
+// Called with the whole message, from F0h to F7h inclusive.
+typedef void (*sysex_handler)(struct midi_endpoint source, const uint8_t *message, uint16_t length);
+
+bool sysex_assembler_register_handler(const uint8_t *prefix, uint8_t prefix_length, sysex_handler);
+
+// Code index numbers 4h to 7h carry sysex.  This is all the notes and
+// controllers ever have to pay for, so callers should check it before calling
+// sysex_assembler_process_packet.
+static inline bool is_sysex_packet(const uint8_t *packet) {
+    uint8_t code_index = packet[0] & 0x0F;
+    return code_index >= 0x4 && code_index <= 0x7;
+}
+
+void sysex_assembler_process_packet(struct midi_endpoint, const uint8_t*);
+
+void sysex_assembler_reset(struct midi_endpoint);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SYSEX_ASSEMBLER_H_ */
@@ -99,9 +99,10 @@ extern "C" {
 
 #define CFG_TUD_MIDI_TX_BUFSIZE     1024
 
-// Support multiple inputs and outputs on the client side so that we can work with a range of Launchpad versions
-#define CFG_TUD_MIDI_NUMCABLES_IN   3
-#define CFG_TUD_MIDI_NUMCABLES_OUT  3
+// Support multiple inputs and outputs on the client side so that we can work with a range of Launchpad versions,
+// plus one more for diagnostics (see diagnostics.c)
+#define CFG_TUD_MIDI_NUMCABLES_IN   4
+#define CFG_TUD_MIDI_NUMCABLES_OUT  4
 
 // Support MIDI port string labels after the serial number string
 #define CFG_TUD_MIDI_FIRST_PORT_STRIDX 1
@@ -153,9 +153,11 @@ char const* string_desc_arr [] =
   "Pico Launchpad MK1 Input",
   "Pico Launchpad MK2 Input",
   "Pico Launchpad MK3 Input",
+  "Pico Launchpad Diagnostics In",
   "Pico Launchpad MK1 Output",
   "Pico Launchpad MK2 Output",
   "Pico Launchpad MK3 Output",
+  "Pico Launchpad Diagnostics Out",
 };
 
 static uint16_t _desc_str[32];
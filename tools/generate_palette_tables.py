@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# Generates the colour lookup tables declared in src/palette.h from the palette
+# in src/palette.c, so that the firmware never has to search for the closest
+# colour at runtime.  Run by the build, see CMakeLists.txt.
+#
+# Usage: generate_palette_tables.py <palette.c> <output.c>
+
+import re
+import sys
+
+# These need to match palette.h, which checks them against the generated file.
+LUT_BITS = 4
+MK1_LEVELS = 4
+DITHER_THRESHOLDS = 16
+GRID_SIZE = 10
+
+# A 4 x 4 Bayer matrix, for ordered dithering.
+BAYER_4X4 = [
+    [0, 8, 2, 10],
+    [12, 4, 14, 6],
+    [3, 11, 1, 9],
+    [15, 7, 13, 5],
+]
+
+
+def read_palette(path):
+    with open(path) as source:
+        text = source.read()
+
+    start = text.index("novation_palette[PALETTE_SIZE] = {")
+    end = text.index("};", start)
+    entries = re.findall(r"\{\s*(\d+),\s*(\d+),\s*(\d+)\s*\}", text[start:end])
+
+    palette = [tuple(int(channel) for channel in entry) for entry in entries]
+    if len(palette) != 128:
+        sys.exit("expected 128 palette entries in %s, found %d" % (path, len(palette)))
+
+    return palette
+
+
+# Each cell of the table covers a cube of colours, and gets the palette entry
+# closest to the middle of the cube, by squared distance in RGB.  Ties go to
+# the lowest index.
+def palette_lut(palette):
+    cube = 1 << (7 - LUT_BITS)
+    levels = 1 << LUT_BITS
+    middle = (cube - 1) / 2
+
+    table = []
+    for red in range(levels):
+        for green in range(levels):
+            for blue in range(levels):
+                target = (red * cube + middle, green * cube + middle, blue * cube + middle)
+                distances = [sum((a - b) ** 2 for a, b in zip(target, entry)) for entry in palette]
+                table.append(distances.index(min(distances)))
+
+    return table
+
+
+# The level each value falls in, with the levels spread evenly over 0-127.  A
+# threshold of None picks the nearest level, otherwise the value is pushed up
+# by up to one level, so that an area of cells with every threshold averages
+# out to the right brightness.
+def mk1_level(value, threshold):
+    scaled = value * (MK1_LEVELS - 1) / 127
+    offset = 0.5 if threshold is None else (threshold + 0.5) / DITHER_THRESHOLDS
+    return min(int(scaled + offset), MK1_LEVELS - 1)
+
+
+def format_table(values, indent="  ", per_line=16):
+    lines = []
+    for start in range(0, len(values), per_line):
+        lines.append(indent + ", ".join("%d" % value for value in values[start:start + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: %s <palette.c> <output.c>" % sys.argv[0])
+
+    palette = read_palette(sys.argv[1])
+
+    lut = palette_lut(palette)
+    levels = [mk1_level(value, None) for value in range(128)]
+    dithered_levels = [[mk1_level(value, threshold) for value in range(128)] for threshold in range(DITHER_THRESHOLDS)]
+    thresholds = [BAYER_4X4[(index // GRID_SIZE) % 4][(index % GRID_SIZE) % 4] for index in range(GRID_SIZE * GRID_SIZE)]
+
+    dithered_rows = "\n".join("  {\n%s\n  }," % format_table(row, "    ") for row in dithered_levels)
+
+    output = """// Generated from palette.c by tools/generate_palette_tables.py, don't edit.
+
+#include "palette.h"
+
+_Static_assert(PALETTE_LUT_BITS == %d, "palette.h and the generator disagree");
+_Static_assert(MK1_LEVELS == %d, "palette.h and the generator disagree");
+
+const uint8_t palette_lut[PALETTE_LUT_SIZE] = {
+%s
+};
+
+const uint8_t mk1_levels[128] = {
+%s
+};
+
+#if PALETTE_DITHERING
+_Static_assert(PALETTE_DITHER_THRESHOLDS == %d, "palette.h and the generator disagree");
+
+const uint8_t mk1_dithered_levels[PALETTE_DITHER_THRESHOLDS][128] = {
+%s
+};
+
+const uint8_t grid_dither_thresholds[LAUNCHPAD_GRID_CELLS] = {
+%s
+};
+#endif
+""" % (
+        LUT_BITS,
+        MK1_LEVELS,
+        format_table(lut),
+        format_table(levels),
+        DITHER_THRESHOLDS,
+        dithered_rows,
+        format_table(thresholds, per_line=GRID_SIZE),
+    )
+
+    with open(sys.argv[2], "w") as target:
+        target.write(output)
+
+
+if __name__ == "__main__":
+    main()